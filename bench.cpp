@@ -0,0 +1,361 @@
+// Benchmarks for flat::bst against std::set, a sorted std::vector (and std::flat_set / absl::btree_set
+// when available; define FLAT_BST_BENCH_ABSL for absl), across key types, sizes and access patterns.
+// Uses Google Benchmark:
+//	g++ -std=c++20 -O2 -DNDEBUG -Iincludes bench.cpp -lbenchmark -pthread -o bench
+//	./bench --benchmark_filter=find/ --benchmark_out=bench_output.txt
+// Sizes run from 1K up to FLAT_BST_BENCH_MAX_N (default 1M; define it as 100000000 for the 100M runs,
+// which need tens of GB for the larger key types).
+#include "flat_bst.hpp"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#if __has_include(<flat_set>)
+#include <flat_set>
+#endif
+#if defined(FLAT_BST_BENCH_ABSL) && __has_include(<absl/container/btree_set.h>)
+#include <absl/container/btree_set.h>
+#define FLAT_BST_HAVE_ABSL 1
+#endif
+
+#ifndef FLAT_BST_BENCH_MAX_N
+#define FLAT_BST_BENCH_MAX_N (1 << 20)
+#endif
+
+namespace {
+	// ---- key types ----
+	struct record64{ // a 64-byte struct ordered by its first field
+		std::uint64_t key;
+		std::array<char, 56> payload;
+		friend bool operator<(const record64& a, const record64& b) noexcept{ return a.key < b.key; }
+		friend bool operator==(const record64& a, const record64& b) noexcept{ return a.key == b.key; }
+	};
+	static_assert(sizeof(record64) == 64);
+
+	constexpr std::uint64_t mix(std::uint64_t x) noexcept{ // splitmix64 finalizer: distinct inputs, distinct outputs
+		x += 0x9e3779b97f4a7c15ull;
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+		return x ^ (x >> 31);
+	}
+
+	// the i-th smallest key of a data set: keys are increasing in i, so "sorted" input is just i = 0, 1, 2...
+	template<class K> K key_at(std::uint64_t i);
+	template<> std::uint32_t key_at<std::uint32_t>(std::uint64_t i){ return static_cast<std::uint32_t>(i * 3); }
+	template<> std::uint64_t key_at<std::uint64_t>(std::uint64_t i){ return i * 0x10001ull; }
+	template<> std::string key_at<std::string>(std::uint64_t i){
+		char buf[32]; // 24 chars: past the small-string buffer, so each key owns a heap block like real strings
+		std::snprintf(buf, sizeof(buf), "key-%020llu", static_cast<unsigned long long>(i));
+		return buf;
+	}
+	template<> record64 key_at<record64>(std::uint64_t i){
+		record64 r{i, {}};
+		std::memset(r.payload.data(), static_cast<int>(i & 0xff), r.payload.size());
+		return r;
+	}
+
+	template<class K> constexpr const char* key_name = "";
+	template<> constexpr const char* key_name<std::uint32_t> = "u32";
+	template<> constexpr const char* key_name<std::uint64_t> = "u64";
+	template<> constexpr const char* key_name<std::string> = "string";
+	template<> constexpr const char* key_name<record64> = "record64";
+
+	// ---- access patterns: which of the n keys are touched, in what order ----
+	enum class pattern{ random, sorted, zipfian, churn };
+	constexpr const char* pattern_names[] = {"random", "sorted", "zipfian", "churn"};
+
+	// n ranks in [0, n): a permutation for random/sorted/churn, skewed draws (s = 0.99) for zipfian
+	std::vector<std::uint64_t> ranks(std::size_t n, pattern p, std::uint64_t seed = 42){
+		std::vector<std::uint64_t> out(n);
+		for(std::size_t i = 0; i < n; ++i) out[i] = i;
+		std::mt19937_64 rng(seed);
+		if(p == pattern::random || p == pattern::churn){
+			std::shuffle(out.begin(), out.end(), rng);
+		} else if(p == pattern::zipfian){
+			// inverse-CDF approximation of a Zipf distribution; hot ranks are scattered by mix
+			const double s = 0.99, hn = (std::pow(double(n), 1.0 - s) - 1.0) / (1.0 - s) + 1.0;
+			std::uniform_real_distribution<double> u(0.0, 1.0);
+			for(auto& r : out){
+				const double x = std::pow(u(rng) * hn * (1.0 - s) + 1.0, 1.0 / (1.0 - s)) - 1.0;
+				r = mix(std::min<std::uint64_t>(static_cast<std::uint64_t>(x), n - 1)) % n;
+			}
+		}
+		return out;
+	}
+
+	template<class K>
+	std::vector<K> keys_for(const std::vector<std::uint64_t>& r){
+		std::vector<K> out;
+		out.reserve(r.size());
+		for(auto i : r) out.push_back(key_at<K>(i));
+		return out;
+	}
+
+	// ---- containers behind one interface ----
+	// skews: sorted inserts build a chain, O(n^2) to fill. slow_updates: O(n) per insert or erase.
+	// Both get their sizes capped where that would dominate the run, see register_container
+	template<class K, class Policy = flat::default_policy>
+	struct flat_bst_c{
+		static constexpr bool skews = std::is_same_v<typename Policy::balance, flat::unbalanced>;
+		static constexpr bool slow_updates = false;
+		flat::bst<K, std::less<K>, std::uint32_t, Policy> c;
+		void reserve(std::size_t n){ c.reserve(n); }
+		void insert(const K& k){ c.insert(k); }
+		bool find(const K& k) const{ return c.find_handle(k) != c.npos; }
+		bool lower_bound(const K& k) const{ return c.lower_bound_handle(k) != c.npos; }
+		void erase(const K& k){ c.erase(k); }
+		template<class F> void for_each(F&& f) const{ for(const K& k : c) f(k); }
+		template<class It> void build(It first, It last){ c.build_from_range(first, last); }
+		void rebuild(){ c.rebuild_balanced(); }
+	};
+
+	template<class K>
+	struct std_set_c{
+		static constexpr bool skews = false;
+		static constexpr bool slow_updates = false;
+		std::set<K> c;
+		void reserve(std::size_t){}
+		void insert(const K& k){ c.insert(k); }
+		bool find(const K& k) const{ return c.find(k) != c.end(); }
+		bool lower_bound(const K& k) const{ return c.lower_bound(k) != c.end(); }
+		void erase(const K& k){ c.erase(k); }
+		template<class F> void for_each(F&& f) const{ for(const K& k : c) f(k); }
+		template<class It> void build(It first, It last){ c = std::set<K>(first, last); }
+		void rebuild(){}
+	};
+
+	template<class K>
+	struct sorted_vector_c{ // what std::flat_set does, for toolchains without <flat_set>
+		static constexpr bool skews = false;
+		static constexpr bool slow_updates = true;
+		std::vector<K> c;
+		void reserve(std::size_t n){ c.reserve(n); }
+		void insert(const K& k){
+			auto it = std::lower_bound(c.begin(), c.end(), k);
+			if(it == c.end() || k < *it) c.insert(it, k);
+		}
+		bool find(const K& k) const{ return std::binary_search(c.begin(), c.end(), k); }
+		bool lower_bound(const K& k) const{ return std::lower_bound(c.begin(), c.end(), k) != c.end(); }
+		void erase(const K& k){
+			auto it = std::lower_bound(c.begin(), c.end(), k);
+			if(it != c.end() && !(k < *it)) c.erase(it);
+		}
+		template<class F> void for_each(F&& f) const{ for(const K& k : c) f(k); }
+		template<class It> void build(It first, It last){
+			c.assign(first, last);
+			std::sort(c.begin(), c.end());
+			c.erase(std::unique(c.begin(), c.end()), c.end());
+		}
+		void rebuild(){}
+	};
+
+#if defined(__cpp_lib_flat_set)
+	template<class K>
+	struct flat_set_c{
+		static constexpr bool skews = false;
+		static constexpr bool slow_updates = true;
+		std::flat_set<K> c;
+		void reserve(std::size_t){}
+		void insert(const K& k){ c.insert(k); }
+		bool find(const K& k) const{ return c.find(k) != c.end(); }
+		bool lower_bound(const K& k) const{ return c.lower_bound(k) != c.end(); }
+		void erase(const K& k){ c.erase(k); }
+		template<class F> void for_each(F&& f) const{ for(const K& k : c) f(k); }
+		template<class It> void build(It first, It last){ c = std::flat_set<K>(first, last); }
+		void rebuild(){}
+	};
+#endif
+
+#if defined(FLAT_BST_HAVE_ABSL)
+	template<class K>
+	struct absl_btree_c{
+		static constexpr bool skews = false;
+		static constexpr bool slow_updates = false;
+		absl::btree_set<K> c;
+		void reserve(std::size_t){}
+		void insert(const K& k){ c.insert(k); }
+		bool find(const K& k) const{ return c.find(k) != c.end(); }
+		bool lower_bound(const K& k) const{ return c.lower_bound(k) != c.end(); }
+		void erase(const K& k){ c.erase(k); }
+		template<class F> void for_each(F&& f) const{ for(const K& k : c) f(k); }
+		template<class It> void build(It first, It last){ c = absl::btree_set<K>(first, last); }
+		void rebuild(){}
+	};
+#endif
+
+	template<class C, class K, class Order>
+	C filled(const Order& keys){
+		C c;
+		c.reserve(keys.size());
+		for(const K& k : keys) c.insert(k);
+		return c;
+	}
+
+	// ---- benchmarks. state.range(0) is n, every one reports items/s over the keys it touches ----
+	template<class C, class K>
+	void bm_insert(benchmark::State& state, pattern p){
+		const auto n = static_cast<std::size_t>(state.range(0));
+		const auto keys = keys_for<K>(ranks(n, p));
+		for(auto _ : state){
+			C c;
+			c.reserve(n);
+			for(const K& k : keys) c.insert(k);
+			benchmark::DoNotOptimize(c);
+		}
+		state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * n));
+	}
+
+	template<class C, class K, bool Lower>
+	void bm_lookup(benchmark::State& state, pattern p){
+		const auto n = static_cast<std::size_t>(state.range(0));
+		const C c = filled<C, K>(keys_for<K>(ranks(n, pattern::random)));
+		auto probe_ranks = ranks(n, p, 7);
+		if constexpr(Lower){ for(auto& r : probe_ranks) r = r * 2 + 1; } // mostly misses between keys (or past the end)
+		const auto probes = keys_for<K>(probe_ranks);
+		for(auto _ : state){
+			std::size_t hits = 0;
+			for(const K& k : probes) hits += Lower ? c.lower_bound(k) : c.find(k);
+			benchmark::DoNotOptimize(hits);
+		}
+		state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * n));
+	}
+
+	template<class C, class K>
+	void bm_erase(benchmark::State& state, pattern p){
+		const auto n = static_cast<std::size_t>(state.range(0));
+		const auto keys = keys_for<K>(ranks(n, pattern::random));
+		const auto order = keys_for<K>(ranks(n, p, 9));
+		for(auto _ : state){
+			state.PauseTiming();
+			C c = filled<C, K>(keys);
+			state.ResumeTiming();
+			for(const K& k : order) c.erase(k);
+			benchmark::DoNotOptimize(c);
+		}
+		state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * n));
+	}
+
+	// steady state after mixed erases and inserts: shows what hole reuse does to locality
+	template<class C, class K>
+	void bm_iterate(benchmark::State& state, pattern p){
+		const auto n = static_cast<std::size_t>(state.range(0));
+		C c = filled<C, K>(keys_for<K>(ranks(n, p == pattern::sorted ? pattern::sorted : pattern::random)));
+		if(p == pattern::churn){
+			const auto r = ranks(n, pattern::random, 3);
+			for(std::size_t i = 0; i < n / 2; ++i){ c.erase(key_at<K>(r[i])); c.insert(key_at<K>(n + r[i])); }
+		}
+		for(auto _ : state){
+			std::size_t count = 0;
+			c.for_each([&](const K& k){ benchmark::DoNotOptimize(&k); ++count; });
+			benchmark::DoNotOptimize(count);
+		}
+		state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * n));
+	}
+
+	// erase a key that is in the container, insert a new one in its place, keep the size at n.
+	// live[j] is the rank now held by position j; p picks the positions, so every erase finds a fresh victim
+	template<class C, class K>
+	void bm_churn(benchmark::State& state, pattern p){
+		const auto n = static_cast<std::size_t>(state.range(0));
+		auto live = ranks(n, pattern::random);
+		C c = filled<C, K>(keys_for<K>(live));
+		const auto positions = ranks(n, p == pattern::churn ? pattern::random : p, 5);
+		std::uint64_t next = n;
+		std::size_t i = 0;
+		for(auto _ : state){
+			auto& victim = live[positions[i]];
+			c.erase(key_at<K>(victim));
+			c.insert(key_at<K>(next));
+			victim = next++;
+			if(++i == positions.size()) i = 0;
+		}
+		state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+	}
+
+	template<class C, class K>
+	void bm_build(benchmark::State& state, pattern p){
+		const auto n = static_cast<std::size_t>(state.range(0));
+		const auto keys = keys_for<K>(ranks(n, p));
+		for(auto _ : state){
+			C c;
+			c.build(keys.begin(), keys.end());
+			benchmark::DoNotOptimize(c);
+		}
+		state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * n));
+	}
+
+	// only flat::bst does work here; sorted inserts give the skewed tree a rebuild exists for
+	template<class C, class K>
+	void bm_rebuild(benchmark::State& state, pattern p){
+		const auto n = static_cast<std::size_t>(state.range(0));
+		const auto keys = keys_for<K>(ranks(n, p));
+		for(auto _ : state){
+			state.PauseTiming();
+			C c = filled<C, K>(keys);
+			state.ResumeTiming();
+			c.rebuild();
+			benchmark::DoNotOptimize(c);
+		}
+		state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * n));
+	}
+
+	template<class C, class K>
+	void register_container(const std::string& name){
+		constexpr std::int64_t lo = 1 << 10;
+		constexpr std::int64_t hi = FLAT_BST_BENCH_MAX_N;
+		// fill_sorted: the benchmark fills c in pattern order. updates: it times n inserts or erases
+		auto add = [&](const char* op, auto fn, pattern p, bool fill_sorted, bool updates){
+			std::int64_t top = hi;
+			if(C::skews && fill_sorted && p == pattern::sorted) top = std::min<std::int64_t>(top, 1 << 14);
+			if(C::slow_updates && updates) top = std::min<std::int64_t>(top, 1 << 17);
+			const std::string id = std::string(op) + "/" + name + "/" + key_name<K> + "/" + pattern_names[static_cast<int>(p)];
+			benchmark::RegisterBenchmark(id.c_str(), fn, p)->RangeMultiplier(10)->Range(lo, std::max(lo, top))->Unit(benchmark::kMillisecond);
+		};
+		for(pattern p : {pattern::random, pattern::sorted, pattern::zipfian}){
+			add("insert", bm_insert<C, K>, p, true, true);
+			add("find", bm_lookup<C, K, false>, p, false, false);
+			add("lower_bound", bm_lookup<C, K, true>, p, false, false);
+			add("erase", bm_erase<C, K>, p, false, true);
+			add("build_from_range", bm_build<C, K>, p, false, false);
+		}
+		for(pattern p : {pattern::random, pattern::sorted, pattern::churn}) add("iterate", bm_iterate<C, K>, p, true, false);
+		for(pattern p : {pattern::random, pattern::zipfian}) add("churn", bm_churn<C, K>, p, false, false);
+		if constexpr(requires(C c){ c.c.rebuild_balanced(); }){
+			for(pattern p : {pattern::random, pattern::sorted}) add("rebuild_balanced", bm_rebuild<C, K>, p, true, false);
+		}
+	}
+
+	template<class K>
+	void register_key(){
+		register_container<flat_bst_c<K>, K>("flat::bst");
+		register_container<flat_bst_c<K, flat::avl_policy>, K>("flat::bst<avl>");
+		register_container<std_set_c<K>, K>("std::set");
+		register_container<sorted_vector_c<K>, K>("sorted_vector");
+#if defined(__cpp_lib_flat_set)
+		register_container<flat_set_c<K>, K>("std::flat_set");
+#endif
+#if defined(FLAT_BST_HAVE_ABSL)
+		register_container<absl_btree_c<K>, K>("absl::btree_set");
+#endif
+	}
+}
+
+int main(int argc, char** argv){
+	register_key<std::uint32_t>();
+	register_key<std::uint64_t>();
+	register_key<std::string>();
+	register_key<record64>();
+	benchmark::Initialize(&argc, argv);
+	if(benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
@@ -9,18 +9,33 @@
 
 #pragma once
 #include <algorithm>
+#include <array>
 #include <bit>
 #include <cassert>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <functional>
 #include <iterator>
 #include <limits>
 #include <memory>
+#include <memory_resource>
 #include <new>
+#include <optional>
+#include <ostream>
+#include <span>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
 #include <stdexcept>
 #include <type_traits>
 #include <utility>
 #include <vector>
+// execution-policy overloads (parallel builds and scans) are opt-in: define FLAT_BST_PARALLEL before
+// including. libstdc++'s <execution> needs TBB at link time (-ltbb) as soon as it is included.
+#if defined(FLAT_BST_PARALLEL)
+#include <execution>
+#endif
 
 namespace flat {
 	// Configuration traits for packing Index + Generation into IndexT
@@ -41,8 +56,8 @@ namespace flat {
 
 		static_assert(gen_bits >= 0 && gen_bits < total_bits, "gen_bits must be in [0, digits)");
 		static constexpr int idx_bits = total_bits - gen_bits;
-		static constexpr IndexT idx_mask = (~IndexT(0)) >> gen_bits;
-		static constexpr IndexT gen_mask = ~idx_mask;
+		static constexpr IndexT idx_mask = static_cast<IndexT>(static_cast<IndexT>(~IndexT(0)) >> gen_bits); // cast first: ~ promotes narrow types to int
+		static constexpr IndexT gen_mask = static_cast<IndexT>(~idx_mask);
 		static constexpr IndexT gen_value_mask = (gen_bits == 0) ? IndexT(0) : (IndexT(1) << gen_bits) - 1;
 
 		static constexpr IndexT unpack_index(IndexT handle) noexcept{ return handle & idx_mask; }
@@ -51,79 +66,630 @@ namespace flat {
 		static constexpr IndexT wrap_gen(IndexT g) noexcept{
 			if constexpr(gen_bits == 0){ return IndexT(0); } else{ return g & gen_value_mask; }//ensure the stored generation is always in-range
 		}
-	};	
+	};
+
+	// bst::stats(): shape, free-list and locality figures, for deciding when to rebuild or compact
+	struct tree_stats final{
+		std::size_t size = 0;				// live elements
+		std::size_t slots = 0;				// live + free slots in storage
+		std::size_t free_slots = 0;			// length of the free list
+		double fill_ratio = 0;				// size / slots, 1 when nothing is free
+		std::size_t height = 0;				// levels, 0 when empty: the longest search visits this many nodes
+		double average_depth = 0;			// mean nodes visited by a successful search
+		std::vector<std::size_t> depth_histogram; // [d] = elements d links below the root
+		double average_link_distance = 0;	// mean |child slot - parent slot|, small when subtrees share cache lines
+	};
+
+	// bst::probe_counts() with counting_policy
+	struct probe_counters final{
+		std::size_t searches = 0;		// descents from the root
+		std::size_t nodes_visited = 0;
+		std::size_t comparisons = 0;	// calls to Compare
+	};
+
+	// Slot placement used when building a balanced tree from sorted input.
+	// The tree shape is identical for every layout, only the order in storage differs.
+	enum class layout : uint8_t{
+		preorder,	// midpoint first, then the whole left subtree (default)
+		eytzinger,	// breadth-first: each level occupies a contiguous run of slots
+		veb			// van Emde Boas: recursively split by height so small subtrees share cache lines
+	};
+
+	// Balancing strategies for flat::bst, selected through Policy::balance.
+	struct unbalanced final{};	// plain BST: insert order decides the shape, call rebuild_balanced() as needed
+	struct avl final{};			// AVL rotations in insert/erase. Subtree heights live in the spare high bits of Slot::generation.
+
+	// Scapegoat balancing with alpha = Num / Den: an insert landing deeper than log_{1/alpha}(size())
+	// rebuilds just the unbalanced subtree above it, in place. Values never move, handles stay valid.
+	template<unsigned Num = 7, unsigned Den = 10>
+	struct scapegoat final{
+		static_assert(Den < 2 * Num && Num < Den, "alpha = Num / Den must be in (0.5, 1)");
+		static constexpr unsigned num = Num;
+		static constexpr unsigned den = Den;
+	};
+
+	// What tripped a maintenance_policy threshold, as bit flags
+	enum class maintenance_reason : uint8_t{
+		none = 0,
+		too_deep = 1,	// an insert landed deeper than max_depth_factor times the height of a balanced tree
+		fragmented = 2	// more than max_free_ratio of the slots are on the free list
+	};
+	[[nodiscard]] constexpr maintenance_reason operator|(maintenance_reason a, maintenance_reason b) noexcept{
+		return static_cast<maintenance_reason>(uint8_t(a) | uint8_t(b));
+	}
+	[[nodiscard]] constexpr maintenance_reason operator&(maintenance_reason a, maintenance_reason b) noexcept{
+		return static_cast<maintenance_reason>(uint8_t(a) & uint8_t(b));
+	}
+
+	// What a tree does once a maintenance_policy threshold is crossed. Handle contract: no mode ever
+	// invalidates a handle on its own. Depth repairs only relink, so handles stay valid; fragmentation
+	// needs rebuild_compact(), which INVALIDATES all handles, so it is never started automatically: it is
+	// reported through on_maintenance_due() in every mode, and repaired by maintain(on_relocate), where the
+	// caller sees every relocation. Every mode reports what it did not repair, once per crossing.
+	enum class maintenance_mode : uint8_t{
+		rebuild,	// inside the insert: rebalance_in_place() the whole tree when it went too deep
+		amortized,	// inside the insert, relinking only the subtree that went too deep (the scapegoat rule, with
+					// alpha = 2^(-1 / max_depth_factor)): O(log n) per insert, amortized, instead of O(n) bursts
+		notify		// (default) only report through the on_maintenance_due() callback: call maintain() when it suits you
+	};
+
+	// Thresholds for maintenance_policy. Derive and override what you need. Only unbalanced trees
+	// check depth, AVL and scapegoat trees bound their own height.
+	struct maintenance_defaults{
+		static constexpr double max_depth_factor = 2.0;	// too_deep: an insert at depth > factor * bit_width(size())
+		static constexpr double max_free_ratio = 0.5;	// fragmented: free slots > ratio * all slots
+		static constexpr std::size_t min_size = 64;		// smaller trees (or slot arrays) never trip
+		static constexpr maintenance_mode mode = maintenance_mode::notify;
+		static constexpr layout order = layout::preorder;	// slot order after a compaction
+	};
+
+	// Compile-time knobs for flat::bst. Derive from default_policy and override what you need.
+	struct default_policy{
+		using balance = unbalanced;
+		using allocator = std::allocator<std::byte>; // rebound for slot storage and scratch buffers
+	};
+
+	struct avl_policy : default_policy{
+		using balance = avl;
+	};
+
+	struct scapegoat_policy : default_policy{
+		using balance = scapegoat<>;
+	};
+
+	// Any policy, with storage and scratch buffers drawn from a std::pmr::memory_resource
+	template<class Base = default_policy>
+	struct pmr_policy : Base{
+		using allocator = std::pmr::polymorphic_allocator<std::byte>;
+	};
+
+	// Any policy, with storage split into arrays: links, generations and the key that KeyOf projects out
+	// of each value in one, the full values in another. Searches touch only the first: a value is read
+	// on a hit, never on the way down. Compare orders keys, look up by bare key through a transparent Compare.
+	template<class KeyOf, class Base = default_policy>
+	struct soa_policy : Base{
+		using key_of = KeyOf;
+	};
+
+	// Any policy, with values kept whole in the slots and ordered by the key that KeyOf projects out of each.
+	// Unlike soa_policy nothing is stored twice: a search reads the key inside the value, so values can
+	// have const members (flat::map keeps std::pair<const Key, T>). Compare orders keys, as above.
+	template<class KeyOf, class Base = default_policy>
+	struct key_policy : Base{
+		using key_of = KeyOf;
+		static constexpr bool values_in_slots = true;
+	};
+
+	// KeyOf for a data member, e.g. soa_policy<key_member<&record::id>>
+	template<auto Member>
+	struct key_member final{
+		template<class U>
+		constexpr const auto& operator()(const U& u) const noexcept{ return u.*Member; }
+	};
+
+	// A balanced policy plus a subtree size in every slot, for nth(k), rank(key) and count(lo, hi) in O(log n).
+	// sizes are repaired bottom-up along the search path, which only the self-balancing policies keep
+	template<class Base = avl_policy>
+	struct order_statistics_policy : Base{
+		static constexpr bool order_statistics = true;
+	};
+
+	// A balanced policy plus a per-subtree aggregate, for aggregate(lo, hi) and pruned traversals in O(log n)
+	// (sums, min/max, interval trees keyed on the start with the max end as aggregate). Monoid provides
+	//   using value_type = ...;  identity(), lift(const T&) and an associative combine(a, b), none of which may throw.
+	// aggregates are repaired like order_statistics_policy sizes, and the two can be stacked
+	template<class Monoid, class Base = avl_policy>
+	struct augment_policy : Base{
+		using augment = Monoid;
+	};
+
+	// Any policy, plus counters of searches, nodes visited and key comparisons in the descents
+	// (find, insert, erase), read back through bst::probe_counts(). Counting mutates the tree
+	// in const lookups, so a counting tree must not be read from several threads at once.
+	template<class Base = default_policy>
+	struct counting_policy : Base{
+		static constexpr bool count_probes = true;
+	};
+
+	// Any policy, plus triggers that report (and, for depth, optionally repair) a tree that gets too deep
+	// or too holey, so nobody has to guess when a rebuild pays off. See maintenance_defaults and maintenance_mode.
+	template<class Triggers = maintenance_defaults, class Base = default_policy>
+	struct maintenance_policy : Base{
+		using maintenance = Triggers;
+	};
+
+	// Any policy, with room for N slots kept inline: no heap, not even for traversal stacks (freeze() and
+	// stats() excepted). inserting past N throws std::length_error
+	template<std::size_t N, class Base = default_policy>
+	struct inline_policy : Base{
+		static constexpr std::size_t inline_capacity = N;
+	};
 };
 
+namespace flat::detail {
+	// what flat::bst compares: the whole value, or what Policy::key_of projects from it
+	template<class T, class Policy>
+	struct key_type_of{ using type = T; };
+	template<class T, class Policy> requires requires{ typename Policy::key_of; }
+	struct key_type_of<T, Policy>{ using type = std::remove_cvref_t<std::invoke_result_t<typename Policy::key_of, const T&>>; };
+
+	// stand-in for per-slot data a policy did not ask for
+	struct none final{};
+	constexpr void swap(none&, none&) noexcept{}
+
+	// state that const lookups update. Boxed so that only the trees that have it lose constexpr
+	// variables: a mutable member, even an empty one, keeps an object from being a constant
+	template<class T>
+	struct mutable_box final{ mutable T value{}; };
+
+	// what augment_policy stores per slot, none without one
+	template<class Policy>
+	struct aggregate_of{ using type = none; };
+	template<class Policy> requires requires{ typename Policy::augment; }
+	struct aggregate_of<Policy>{ using type = typename Policy::augment::value_type; };
+
+	// smallest index type whose index field can address N slots next to the null sentinel
+	template<std::size_t N>
+	using index_for_capacity =
+		std::conditional_t<N <= index_layout<uint8_t>::idx_mask, uint8_t,
+		std::conditional_t<N <= index_layout<uint16_t>::idx_mask, uint16_t,
+		std::conditional_t<N <= index_layout<uint32_t>::idx_mask, uint32_t, uint64_t>>>;
+
+	// The subset of std::vector that flat::bst uses, over a fixed inline array. Cells past size()
+	// hold default-constructed Us, so U must be default constructible. reserve() is only a hint.
+	template<class U, std::size_t N>
+	class inline_vector final{
+	public:
+		using value_type = U;
+		using size_type = std::size_t;
+		using iterator = U*;
+		using const_iterator = const U*;
+
+		constexpr inline_vector() = default;
+		template<class Alloc>
+		constexpr explicit inline_vector(const Alloc&) noexcept{} // nothing to allocate from
+
+		[[nodiscard]] constexpr size_type size() const noexcept{ return size_; }
+		[[nodiscard]] constexpr bool empty() const noexcept{ return size_ == 0; }
+		[[nodiscard]] static constexpr size_type capacity() noexcept{ return N; }
+		constexpr void reserve(size_type) const noexcept{}
+		constexpr void shrink_to_fit() const noexcept{}
+
+		constexpr U& operator[](size_type i) noexcept{ return data_[i]; }
+		constexpr const U& operator[](size_type i) const noexcept{ return data_[i]; }
+		constexpr U& back() noexcept{ return data_[size_ - 1]; }
+		constexpr const U& back() const noexcept{ return data_[size_ - 1]; }
+		constexpr iterator begin() noexcept{ return data_.data(); }
+		constexpr iterator end() noexcept{ return data_.data() + size_; }
+		constexpr const_iterator begin() const noexcept{ return data_.data(); }
+		constexpr const_iterator end() const noexcept{ return data_.data() + size_; }
+		constexpr U* data() noexcept{ return data_.data(); }
+		constexpr const U* data() const noexcept{ return data_.data(); }
+
+		template<class... Args>
+		constexpr U& emplace_back(Args&&... args){
+			if(size_ == N) throw std::length_error("inline capacity exceeded");
+			data_[size_] = U(std::forward<Args>(args)...);
+			return data_[size_++];
+		}
+		constexpr void push_back(const U& v){ emplace_back(v); }
+		constexpr void push_back(U&& v){ emplace_back(std::move(v)); }
+		constexpr void pop_back() noexcept{ data_[--size_] = U{}; }
+
+		// only ever used to drop a tail, as in v.erase(std::unique(...), v.end())
+		constexpr iterator erase(iterator first, iterator last){
+			const iterator new_end = std::move(last, end(), first);
+			for(iterator it = new_end; it != end(); ++it){ *it = U{}; }
+			size_ = static_cast<size_type>(new_end - begin());
+			return first;
+		}
+		constexpr void clear() noexcept{
+			for(size_type i = 0; i < size_; ++i){ data_[i] = U{}; }
+			size_ = 0;
+		}
+		constexpr void swap(inline_vector& other) noexcept(std::is_nothrow_swappable_v<U>){
+			using std::swap;
+			std::swap_ranges(begin(), begin() + std::max(size_, other.size_), other.begin());
+			swap(size_, other.size_);
+		}
+
+	private:
+		std::array<U, N> data_{};
+		size_type size_ = 0;
+	};
+
+	// Compare opts into heterogeneous lookup the same way it does for std::set
+	template<class C>
+	concept transparent = requires{ typename C::is_transparent; };
+
+	// best-effort software prefetch; a no-op where the compiler offers none
+	inline void prefetch(const void* p) noexcept{
+#if defined(__GNUC__) || defined(__clang__)
+		__builtin_prefetch(p);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		_mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+#else
+		(void) p;
+#endif
+	}
+
+	// Branchless descent over an implicit Eytzinger array: node k (1-based) lives at base[k-1],
+	// its children at 2k and 2k+1. Every step is a compare and a shift, no data-dependent branch.
+	// Returns the 1-based position of the first element for which go_right(elem) is false, or 0.
+	template<class T, class GoRight>
+	constexpr std::size_t eytzinger_search(const T* base, std::size_t n, GoRight&& go_right) noexcept{
+		// prefetch the descendants levels_ahead levels down; they are contiguous and fill about one cache line
+		constexpr int levels_ahead = std::max(1, static_cast<int>(std::bit_width(64 / std::max<std::size_t>(sizeof(T), 1))) - 1);
+		std::size_t k = 1;
+		while(k <= n){
+			if(!std::is_constant_evaluated()){
+				// address arithmetic only, the prefetch target may lie past the end
+				prefetch(reinterpret_cast<const void*>(reinterpret_cast<std::uintptr_t>(base) + ((k << levels_ahead) - 1) * sizeof(T)));
+			}
+			k = 2 * k + static_cast<std::size_t>(go_right(base[k - 1]));
+		}
+		// undo the trailing right turns plus the final left one
+		return k >> (std::countr_one(k) + 1);
+	}
+
+	// On-disk format written by bst::save() and read by flat::mapped_bst: this header, then slot_count
+	// records at offset sizeof(mapped_header). Everything is in native byte order and layout;
+	// byte_order and the size fields reject files from a different platform or instantiation.
+	struct alignas(64) mapped_header final{
+		static constexpr char magic_value[8] = {'f', 'l', 'a', 't', 'b', 's', 't', '\0'};
+		static constexpr std::uint32_t current_version = 1;
+		static constexpr std::uint32_t byte_order_mark = 0x01020304;
+
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t byte_order;
+		std::uint32_t index_bytes;
+		std::uint32_t value_bytes;
+		std::uint32_t value_align;
+		std::uint32_t record_bytes;
+		std::uint64_t slot_count;
+		std::uint64_t alive_count;
+		std::uint64_t root;
+		std::uint64_t free_head;
+		std::uint64_t checksum; // fnv1a over all records
+	};
+
+	// one slot on disk. generation keeps the AVL height bits, value is zeroed in dead slots
+	template<class T, class IndexT>
+	struct mapped_slot final{
+		IndexT generation;
+		IndexT left;
+		IndexT right;
+		union{ T value; }; // no default constructor needed from T
+
+		mapped_slot() noexcept{ std::memset(static_cast<void*>(this), 0, sizeof(*this)); } // padding too, so checksums are reproducible
+	};
+
+	inline constexpr std::uint64_t fnv1a_seed = 14695981039346656037ull;
+	inline std::uint64_t fnv1a(const void* data, std::size_t n, std::uint64_t h = fnv1a_seed) noexcept{
+		const auto* p = static_cast<const unsigned char*>(data);
+		for(std::size_t i = 0; i < n; ++i){ h = (h ^ p[i]) * 1099511628211ull; }
+		return h;
+	}
+}
+
+namespace flat {
+	template<class T, class Compare, class IndexT, class Policy>
+	class bst;
+
+	// Immutable snapshot of a flat::bst, see bst::freeze().
+	// Holds only the values, in implicit Eytzinger order (children of i at 2i+1 / 2i+2),
+	// so there are no links to store or chase. Lookups are branchless and prefetch ahead.
+	template<class T, class Compare = std::less<T>>
+	class frozen_bst final{
+	public:
+		using value_type = T;
+		using size_type = std::size_t;
+
+		frozen_bst() = default;
+
+		constexpr explicit frozen_bst(Compare cmp) noexcept(std::is_nothrow_move_constructible_v<Compare>)
+			: comp_(std::move(cmp)){}
+
+		// input must be sorted and unique according to Compare
+		template<class It>
+			requires std::random_access_iterator<It>
+		frozen_bst(It first, It last, Compare cmp = Compare{}) : comp_(std::move(cmp)){
+			assert(std::is_sorted(first, last, comp_) && "Input range must be sorted according to Compare");
+			assign_(static_cast<size_type>(std::distance(first, last)), [&](size_type rank) -> decltype(auto){
+				return first[static_cast<std::ptrdiff_t>(rank)];
+				});
+		}
+
+		[[nodiscard]] constexpr bool empty() const noexcept{ return vals_.empty(); }
+		[[nodiscard]] constexpr size_type size() const noexcept{ return vals_.size(); }
+
+		// Lookups accept any K when Compare is transparent, like flat::bst
+		[[nodiscard]] constexpr bool contains(const value_type& key) const noexcept{ return find_ptr_(key) != nullptr; }
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] constexpr bool contains(const K& key) const noexcept{ return find_ptr_(key) != nullptr; }
+
+		[[nodiscard]] constexpr const value_type* find_ptr(const value_type& key) const noexcept{ return find_ptr_(key); }
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] constexpr const value_type* find_ptr(const K& key) const noexcept{ return find_ptr_(key); }
+
+		// First element for which !comp_(elem, key), or nullptr
+		[[nodiscard]] constexpr const value_type* lower_bound(const value_type& key) const noexcept{ return lower_bound_(key); }
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] constexpr const value_type* lower_bound(const K& key) const noexcept{ return lower_bound_(key); }
+
+		// First element for which comp_(key, elem), or nullptr
+		[[nodiscard]] constexpr const value_type* upper_bound(const value_type& key) const noexcept{ return upper_bound_(key); }
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] constexpr const value_type* upper_bound(const K& key) const noexcept{ return upper_bound_(key); }
+
+		template<class F>
+		constexpr void for_each_inorder(F&& f) const{
+			size_type k = 1;
+			const size_type n = vals_.size();
+			if(n == 0) return;
+			while(2 * k <= n) k *= 2; // leftmost
+			while(k != 0){
+				f(vals_[k - 1]);
+				if(2 * k + 1 <= n){ // successor: leftmost of the right subtree
+					k = 2 * k + 1;
+					while(2 * k <= n) k *= 2;
+				} else{ // or climb while we are a right child
+					k >>= std::countr_one(k) + 1;
+				}
+			}
+		}
+
+	private:
+		template<class, class, class, class> friend class bst;
+
+		std::vector<value_type> vals_;
+		[[no_unique_address]] Compare comp_{};
+
+		template<class K>
+		constexpr const value_type* find_ptr_(const K& key) const noexcept{
+			const value_type* p = lower_bound_(key);
+			return (p && !comp_(key, *p)) ? p : nullptr;
+		}
+
+		template<class K>
+		constexpr const value_type* lower_bound_(const K& key) const noexcept{
+			const size_type k = detail::eytzinger_search(vals_.data(), vals_.size(),
+				[&](const value_type& v){ return comp_(v, key); });
+			return k == 0 ? nullptr : &vals_[k - 1];
+		}
+
+		template<class K>
+		constexpr const value_type* upper_bound_(const K& key) const noexcept{
+			const size_type k = detail::eytzinger_search(vals_.data(), vals_.size(),
+				[&](const value_type& v){ return !comp_(key, v); });
+			return k == 0 ? nullptr : &vals_[k - 1];
+		}
+
+		// at_rank(r) yields the r-th smallest value
+		template<class Get>
+		void assign_(size_type n, Get&& at_rank){
+			std::vector<size_type> rank_at(n);
+			size_type next_rank = 0;
+			auto fill = [&](auto&& self, size_type k) -> void{
+				if(k > n) return;
+				self(self, 2 * k);
+				rank_at[k - 1] = next_rank++;
+				self(self, 2 * k + 1);
+				};
+			fill(fill, 1);
+			vals_.clear();
+			vals_.reserve(n);
+			for(size_type r : rank_at){ vals_.push_back(at_rank(r)); }
+		}
+	};
+}
+
 namespace flat {
-	template<class T, class Compare = std::less<T>, class IndexT = uint32_t>
+	template<class T, class Compare = std::less<T>, class IndexT = uint32_t, class Policy = default_policy>
 	class bst final{
 		using Layout = index_layout<IndexT>;
 		using index_type = IndexT;
+		static constexpr bool is_avl = std::is_same_v<typename Policy::balance, avl>;
+		static constexpr bool is_scapegoat = requires{ Policy::balance::num; Policy::balance::den; };
+		static constexpr bool is_inline = requires{ Policy::inline_capacity; };
+		static constexpr bool is_keyed = requires{ typename Policy::key_of; }; // Compare orders a key projected out of T
+		static constexpr bool is_soa = is_keyed && !requires{ Policy::values_in_slots; }; // that key copied next to the links
+		static constexpr bool has_sizes = []{
+			if constexpr(requires{ Policy::order_statistics; }){ return bool(Policy::order_statistics); } else{ return false; }
+			}();
+		static constexpr bool has_aggregate = requires{ typename Policy::augment; };
+		static constexpr bool counts_probes = []{
+			if constexpr(requires{ Policy::count_probes; }){ return bool(Policy::count_probes); } else{ return false; }
+			}();
+		static constexpr bool has_maintenance = requires{ typename Policy::maintenance; };
+		static constexpr bool is_augmented = has_sizes || has_aggregate; // something hangs off every node and needs bottom-up repair
+		static_assert(!is_augmented || is_avl || is_scapegoat, "order statistics and aggregates need a balanced policy (avl or scapegoat)");
+		template<class, class, class, class, class> friend class map;
+		static constexpr std::size_t inline_capacity_ = []{
+			if constexpr(is_inline){ return Policy::inline_capacity; } else{ return std::size_t{0}; }
+			}();
+		static_assert(inline_capacity_ <= Layout::idx_mask, "IndexT is too narrow for the inline capacity");
+		template<class U> using alloc_for_ = typename std::allocator_traits<typename Policy::allocator>::template rebind_alloc<U>;
+		template<class U> using scratch_vector_ = std::conditional_t<is_inline,
+			detail::inline_vector<U, inline_capacity_>, std::vector<U, alloc_for_<U>>>;
 
 	public: //let's define an iterator		
 		class inorder_iter final{
 			using tree_t = bst;
-			static constexpr size_t traversal_stack_reserve = 16;
+			// Ancestors of the current node live in a small inline ring, so iterators never allocate
+			// and copy cheaply. Sized to hold the full path of any AVL-balanced tree; in deeper
+			// (degenerate) trees the oldest ancestors fall off and are recovered on demand by one
+			// descent from the root.
+			static constexpr size_t path_capacity = std::bit_ceil(static_cast<size_t>(Layout::idx_bits) * 3 / 2 + 2);
+			static constexpr size_t path_mask = path_capacity - 1;
 			// iterators use raw indices internally for performance, not handles
 			const tree_t* tree_ = nullptr;
-			std::vector<IndexT> stack_;
 			IndexT cur_raw_ = tree_t::null_idx;
+			std::uint16_t head_ = 0;	// ring position of the next push
+			std::uint16_t count_ = 0;	// valid ancestors in the ring, nearest last
+			IndexT path_[path_capacity]{};
+
+			constexpr void push_(IndexT i) noexcept{
+				path_[head_] = i;
+				head_ = static_cast<std::uint16_t>((head_ + 1) & path_mask);
+				if(count_ < path_capacity) ++count_;
+			}
+
+			// pop the parent of cur_raw_, or null_idx at the root
+			constexpr IndexT pop_parent_() noexcept{
+				if(count_ == 0){
+					if(cur_raw_ == tree_->root_idx_) return tree_t::null_idx;
+					refill_();
+				}
+				head_ = static_cast<std::uint16_t>((head_ - 1) & path_mask);
+				--count_;
+				return path_[head_];
+			}
+
+			// the ring ran dry below the root: descend again to recover the nearest ancestors of cur_raw_
+			constexpr void refill_() noexcept{
+				const auto& key = tree_->slots_[cur_raw_].key();
+				for(IndexT i = tree_->root_idx_; i != cur_raw_;){
+					push_(i);
+					i = tree_->comp_(key, tree_->slots_[i].key()) ? tree_->slots_[i].left : tree_->slots_[i].right;
+				}
+			}
 
-			constexpr void push_left_(IndexT i){
-				while(i != tree_t::null_idx){
-					stack_.push_back(i);
+			constexpr void descend_leftmost_(IndexT i) noexcept{
+				while(tree_->slots_[i].left != tree_t::null_idx){
+					push_(i);
 					i = tree_->slots_[i].left;
 				}
-			}	
+				cur_raw_ = i;
+			}
+
+			constexpr void descend_rightmost_(IndexT i) noexcept{
+				while(tree_->slots_[i].right != tree_t::null_idx){
+					push_(i);
+					i = tree_->slots_[i].right;
+				}
+				cur_raw_ = i;
+			}
+
+			// position at the first element for which go_left(raw index) holds (lower/upper bound, nth), or end.
+			// Every visited node is pushed; the ring is then rewound to the state before the answer.
+			template<class GoLeft>
+			constexpr void seek_(GoLeft&& go_left) noexcept{
+				cur_raw_ = tree_t::null_idx;
+				std::uint16_t saved_head = 0, saved_count = 0;
+				size_t pushed_since = 0;
+				for(IndexT i = tree_->root_idx_; i != tree_t::null_idx;){
+					const auto& s = tree_->slots_[i];
+					if(go_left(i)){
+						cur_raw_ = i;
+						saved_head = head_;
+						saved_count = count_;
+						pushed_since = 0;
+						push_(i);
+						i = s.left;
+					} else{
+						push_(i);
+						i = s.right;
+					}
+					++pushed_since;
+				}
+				if(cur_raw_ == tree_t::null_idx){ head_ = 0; count_ = 0; return; }
+				// pushes past the answer may have overwritten its oldest ancestors
+				const size_t kept = pushed_since >= path_capacity ? 0 : std::min<size_t>(saved_count, path_capacity - pushed_since);
+				head_ = saved_head;
+				count_ = static_cast<std::uint16_t>(kept);
+			}
+
+			friend class bst;
 
 		public:
 			using value_type = const T;
 			using reference = const T&;
 			using pointer = const T*;
 			using difference_type = std::ptrdiff_t;
-			using iterator_category = std::forward_iterator_tag;
+			using iterator_category = std::bidirectional_iterator_tag;
 
 			constexpr inorder_iter() = default;
-			explicit constexpr inorder_iter(const tree_t* t, bool end) : tree_(t){
+			explicit constexpr inorder_iter(const tree_t* t, bool end) noexcept : tree_(t){
 				if(!t || end || t->empty()){ cur_raw_ = tree_t::null_idx; return; }
-				stack_.reserve(traversal_stack_reserve);
-				push_left_(t->root_idx_);
-				if(!stack_.empty()){
-					cur_raw_ = stack_.back();
-					stack_.pop_back();
-				} else{
-					cur_raw_ = tree_t::null_idx;
-				}
+				descend_leftmost_(t->root_idx_);
 			}
 
-			constexpr reference operator*() const noexcept{ return tree_->slots_[cur_raw_].value(); }
-			constexpr pointer   operator->() const noexcept{ return &tree_->slots_[cur_raw_].value(); }	
+			constexpr reference operator*() const noexcept{ return tree_->value_at_(cur_raw_); }
+			constexpr pointer   operator->() const noexcept{ return &tree_->value_at_(cur_raw_); }	
 			constexpr index_type handle() const noexcept{
 				if(cur_raw_ == tree_t::null_idx) return tree_t::npos;
 				return tree_->make_handle(cur_raw_);
 			}
-			constexpr inorder_iter& operator++(){
-				if(cur_raw_ == tree_t::null_idx) return *this;							
+			constexpr inorder_iter& operator++() noexcept{
+				if(cur_raw_ == tree_t::null_idx) return *this;
 				IndexT right = tree_->slots_[cur_raw_].right;
 				if(right != tree_t::null_idx){
-					push_left_(right);
+					push_(cur_raw_);
+					descend_leftmost_(right);
+					return *this;
+				}
+				// climb until we arrive from a left child
+				for(IndexT child = cur_raw_;; child = cur_raw_){
+					cur_raw_ = pop_parent_();
+					if(cur_raw_ == tree_t::null_idx || tree_->slots_[cur_raw_].left == child) break;
 				}
+				return *this;
+			}
 
-				if(stack_.empty()){
-					cur_raw_ = tree_t::null_idx;
-				} else{
-					cur_raw_ = stack_.back();
-					stack_.pop_back();
+			// --end() is the last element
+			constexpr inorder_iter& operator--() noexcept{
+				if(cur_raw_ == tree_t::null_idx){
+					if(tree_ && !tree_->empty()) descend_rightmost_(tree_->root_idx_);
+					return *this;
+				}
+				IndexT left = tree_->slots_[cur_raw_].left;
+				if(left != tree_t::null_idx){
+					push_(cur_raw_);
+					descend_rightmost_(left);
+					return *this;
+				}
+				// climb until we arrive from a right child
+				for(IndexT child = cur_raw_;; child = cur_raw_){
+					cur_raw_ = pop_parent_();
+					if(cur_raw_ == tree_t::null_idx || tree_->slots_[cur_raw_].right == child) break;
 				}
 				return *this;
 			}
 
-			constexpr inorder_iter operator++(int){
+			constexpr inorder_iter operator++(int) noexcept{
 				auto tmp = *this;
 				++(*this);
 				return tmp;
 			}
 
+			constexpr inorder_iter operator--(int) noexcept{
+				auto tmp = *this;
+				--(*this);
+				return tmp;
+			}
+
 			friend constexpr bool operator==(const inorder_iter& a, const inorder_iter& b) noexcept{
 				return a.tree_ == b.tree_ && a.cur_raw_ == b.cur_raw_;
 			}
@@ -133,23 +699,49 @@ namespace flat {
 		};
 	public:
 		using const_inorder_iterator = inorder_iter;
+		using const_reverse_inorder_iterator = std::reverse_iterator<inorder_iter>;
 		using value_type = T;
+		using key_type = typename detail::key_type_of<T, Policy>::type; // T itself unless Policy::key_of projects a key
 		using size_type = std::size_t;		
 		using handle_type = index_type;
+		using allocator_type = typename Policy::allocator;
+		using aggregate_type = typename detail::aggregate_of<Policy>::type; // detail::none without augment_policy
 		static constexpr handle_type npos = std::numeric_limits<index_type>::max();		
 
+		// old-to-new handle table returned by rebuild_compact(). stale or unknown handles map to npos
+		class handle_remap{
+		public:
+			constexpr handle_remap() = default;
+			[[nodiscard]] constexpr handle_type operator[](handle_type old) const noexcept{
+				const auto idx = static_cast<size_type>(Layout::unpack_index(old));
+				if(old == npos || idx >= entries_.size() || entries_[idx].first != old) return npos;
+				return entries_[idx].second;
+			}
+			[[nodiscard]] constexpr size_type size() const noexcept{ return count_; } // number of relocated elements
+		private:
+			friend class bst;
+			using entry = std::pair<handle_type, handle_type>;
+			constexpr explicit handle_remap(scratch_vector_<entry> entries) noexcept : entries_(std::move(entries)){}
+			scratch_vector_<entry> entries_; // by old slot index: {old, new}
+			size_type count_ = 0;
+		};
+
 		bst() = default;
 
 		constexpr explicit bst(Compare cmp) noexcept(std::is_nothrow_move_constructible_v<Compare>)
 			: comp_(std::move(cmp)){}
 
+		constexpr explicit bst(const allocator_type& alloc) : slots_(alloc_for_<Slot>(alloc)){}
+		constexpr bst(Compare cmp, const allocator_type& alloc) : slots_(alloc_for_<Slot>(alloc)), comp_(std::move(cmp)){}
+
 		// if you already have sorted-unique data, create an empty bst and call build_from_sorted_unique instead
 		// this ctor just does the right thing for arbitrary ranges.
 		template<class It>
-		bst(It first, It last, Compare cmp = Compare{}) : comp_(std::move(cmp)){
+		bst(It first, It last, Compare cmp = Compare{}, const allocator_type& alloc = allocator_type{})
+			: slots_(alloc_for_<Slot>(alloc)), comp_(std::move(cmp)){
 			if(first == last) return;
 			if constexpr(std::random_access_iterator<It>){
-				bool sorted = std::is_sorted(first, last, comp_);
+				bool sorted = std::is_sorted(first, last, value_comp_());
 				bool unique = sorted && std::adjacent_find(first, last, [&](const auto& a, const auto& b){
 					return equiv_(a, b);
 					}) == last;
@@ -161,14 +753,82 @@ namespace flat {
 			build_from_range(first, last);
 		}
 
-		bst(std::initializer_list<value_type> values, Compare cmp = Compare{}) : bst(values.begin(), values.end(), cmp){}			
+		bst(std::initializer_list<value_type> values, Compare cmp = Compare{}, const allocator_type& alloc = allocator_type{})
+			: bst(values.begin(), values.end(), std::move(cmp), alloc){}			
 
+		[[nodiscard]] constexpr allocator_type get_allocator() const noexcept{
+			if constexpr(is_inline){ return allocator_type{}; } else{ return allocator_type(slots_.get_allocator()); }
+		}
 		[[nodiscard]] constexpr bool empty() const noexcept{ return alive_count_ == 0; }
 		[[nodiscard]] constexpr size_type size() const noexcept{ return alive_count_; }
 		[[nodiscard]] constexpr size_type capacity() const noexcept{ return slots_.capacity(); }
-		constexpr void reserve(size_type n){ slots_.reserve(n); }
+
+		// one pass over the tree and one over the free list. depth_histogram is a std::vector on the
+		// global heap, on inline_policy trees too: stats() is a diagnostic, freeze() is the other exception
+		[[nodiscard]] tree_stats stats() const{
+			tree_stats out;
+			out.size = alive_count_;
+			out.slots = slots_.size();
+			for(index_type i = free_head_; i != null_idx; i = slots_[i].right){ ++out.free_slots; }
+			out.fill_ratio = out.slots ? static_cast<double>(out.size) / static_cast<double>(out.slots) : 1.0;
+			if(root_idx_ == null_idx) return out;
+			struct entry{ index_type idx; size_type depth; };
+			auto stack = scratch_<entry>();
+			stack.push_back({root_idx_, 0});
+			size_type depth_sum = 0;
+			double distance_sum = 0;
+			while(!stack.empty()){
+				const entry e = stack.back();
+				stack.pop_back();
+				if(e.depth >= out.depth_histogram.size()) out.depth_histogram.resize(e.depth + 1);
+				++out.depth_histogram[e.depth];
+				depth_sum += e.depth + 1;
+				for(const index_type child : {slots_[e.idx].left, slots_[e.idx].right}){
+					if(child == null_idx) continue;
+					distance_sum += static_cast<double>(child > e.idx ? child - e.idx : e.idx - child);
+					stack.push_back({child, e.depth + 1});
+				}
+			}
+			out.height = out.depth_histogram.size();
+			out.average_depth = static_cast<double>(depth_sum) / static_cast<double>(out.size);
+			out.average_link_distance = out.size > 1 ? distance_sum / static_cast<double>(out.size - 1) : 0.0;
+			return out;
+		}
+
+		// counting_policy only
+		[[nodiscard]] constexpr probe_counters probe_counts() const noexcept requires counts_probes{ return probes_.value; }
+		constexpr void reset_probe_counts() noexcept requires counts_probes{ probes_.value = {}; }
+
+		// maintenance_policy only: which thresholds are crossed right now
+		[[nodiscard]] constexpr maintenance_reason maintenance_due() const noexcept requires has_maintenance{
+			return (maint_.too_deep ? maintenance_reason::too_deep : maintenance_reason::none)
+				| (fragmented_() ? maintenance_reason::fragmented : maintenance_reason::none);
+		}
+		// repair what is due: rebalance_in_place() for depth, rebuild_compact(on_relocate) for fragmentation
+		// (which balances too, and INVALIDATES all handles: on_relocate sees every move). Returns what was repaired
+		template<class F> requires (has_maintenance && std::invocable<F&, handle_type, handle_type>)
+		constexpr maintenance_reason maintain(F&& on_relocate){
+			const maintenance_reason due = maintenance_due();
+			if((due & maintenance_reason::fragmented) != maintenance_reason::none){
+				rebuild_compact(on_relocate, Policy::maintenance::order);
+			} else if(due != maintenance_reason::none){
+				rebalance_in_place();
+			}
+			return due;
+		}
+		// as above, for callers that keep no handles: a compaction's relocations are dropped
+		constexpr maintenance_reason maintain() requires has_maintenance{ return maintain([](handle_type, handle_type){}); }
+		// f(reasons) runs inside the insert or erase that newly crossed a threshold the mode does not repair
+		// itself: depth in notify mode, fragmentation in every mode. Schedule maintain() from it, do not touch the tree
+		void on_maintenance_due(std::function<void(maintenance_reason)> f) requires has_maintenance{ maint_.on_due = std::move(f); }
+		constexpr void reserve(size_type n){
+			slots_.reserve(n);
+			if constexpr(is_soa){ payloads_.reserve(n); }
+		}
 		inline constexpr const_inorder_iterator begin() const{ return const_inorder_iterator(this, false); }
 		inline constexpr const_inorder_iterator end()   const{ return const_inorder_iterator(this, true); }
+		inline constexpr const_reverse_inorder_iterator rbegin() const{ return const_reverse_inorder_iterator(end()); }
+		inline constexpr const_reverse_inorder_iterator rend()   const{ return const_reverse_inorder_iterator(begin()); }
 
 		// returns true if handle is valid AND matches the current generation of the slot
 		[[nodiscard]] constexpr bool is_handle_valid(handle_type handle) const noexcept{
@@ -176,21 +836,21 @@ namespace flat {
 			index_type idx = Layout::unpack_index(handle);
 			index_type gen = Layout::unpack_gen(handle);
 			if(idx >= slots_.size()) return false;
-			return (slots_[idx].generation == gen) && slots_[idx].is_alive();
+			return (slots_[idx].gen() == gen) && slots_[idx].is_alive();
 		}
 
 		// Handle -> value
 		// Fast, non-throwing. nullptr if invalid/stale.
 		[[nodiscard]] constexpr const value_type* try_get(handle_type handle) const noexcept{
 			if(!is_handle_valid(handle)) return nullptr;
-			return &slots_[Layout::unpack_index(handle)].value();
+			return &value_at_(Layout::unpack_index(handle));
 		}
-		[[nodiscard]] value_type* try_get(handle_type handle) noexcept{
+		[[nodiscard]] constexpr value_type* try_get(handle_type handle) noexcept{
 			if(!is_handle_valid(handle)) return nullptr;
-			return &slots_[Layout::unpack_index(handle)].value();
+			return &value_at_(Layout::unpack_index(handle));
 		}
 
-		[[nodiscard]] const value_type& at(handle_type handle) const{
+		[[nodiscard]] constexpr const value_type& at(handle_type handle) const{
 			if(const value_type* p = try_get(handle)) return *p;
 			throw std::out_of_range("flat::bst::at - invalid/stale handle");
 		}
@@ -200,98 +860,353 @@ namespace flat {
 		}
 
 		// Key-based lookup
-		[[nodiscard]] constexpr bool contains(const value_type& key) const noexcept{
-			return find_path_(key).cur != null_idx;
-		}
+		// Each lookup also accepts any K that Compare can order against T when Compare declares
+		// is_transparent (e.g. std::less<> with std::string and std::string_view), so no temporary T is built.
+		[[nodiscard]] constexpr bool contains(const value_type& key) const noexcept{ return contains_(key); }
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] constexpr bool contains(const K& key) const noexcept{ return contains_(key); }
 
 		// Returns handle to matching node, or npos if not found.
-		[[nodiscard]] constexpr handle_type find_handle(const value_type& key) const noexcept{
-			const auto r = find_path_(key);
-			return (r.cur == null_idx) ? npos : make_handle(r.cur);
-		}
+		[[nodiscard]] constexpr handle_type find_handle(const value_type& key) const noexcept{ return find_handle_(key); }
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] constexpr handle_type find_handle(const K& key) const noexcept{ return find_handle_(key); }
 
 		// Convenience: pointer to value, or nullptr if not found.
-		[[nodiscard]] constexpr const value_type* find_ptr(const value_type& key) const noexcept{
-			const auto r = find_path_(key);
-			return (r.cur == null_idx) ? nullptr : &slots_[r.cur].value();
-		}
+		[[nodiscard]] constexpr const value_type* find_ptr(const value_type& key) const noexcept{ return find_ptr_(key); }
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] constexpr const value_type* find_ptr(const K& key) const noexcept{ return find_ptr_(key); }
 
 		// Ordered queries
 		// First element for which !comp_(elem, key) (i.e. elem >= key under Compare)
-		[[nodiscard]] constexpr handle_type lower_bound_handle(const value_type& key) const noexcept{
-			index_type cur = root_idx_;
-			index_type best = null_idx;
-			while(cur != null_idx){
-				const Slot& s = slots_[cur];
-				if(!comp_(s.value(), key)){
-					best = cur;
-					cur = s.left;
-				} else{
-					cur = s.right;
-				}
-			}
-			return (best == null_idx) ? npos : make_handle(best);
-		}
+		[[nodiscard]] constexpr handle_type lower_bound_handle(const value_type& key) const noexcept{ return to_handle_(lower_bound_raw_(key)); }
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] constexpr handle_type lower_bound_handle(const K& key) const noexcept{ return to_handle_(lower_bound_raw_(key)); }
 
 		// First element for which comp_(key, elem) (i.e. elem > key under Compare)
-		[[nodiscard]] constexpr handle_type upper_bound_handle(const value_type& key) const noexcept{
-			index_type cur = root_idx_;
-			index_type best = null_idx;
-			while(cur != null_idx){
-				const Slot& s = slots_[cur];
-				if(comp_(key, s.value())){
-					best = cur;
-					cur = s.left;
-				} else{
-					cur = s.right;
-				}
-			}
-			return (best == null_idx) ? npos : make_handle(best);
-		}
+		[[nodiscard]] constexpr handle_type upper_bound_handle(const value_type& key) const noexcept{ return to_handle_(upper_bound_raw_(key)); }
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] constexpr handle_type upper_bound_handle(const K& key) const noexcept{ return to_handle_(upper_bound_raw_(key)); }
 
 		[[nodiscard]] constexpr std::pair<handle_type, handle_type> equal_range_handle(const value_type& key) const noexcept{
 			return {lower_bound_handle(key), upper_bound_handle(key)};
 		}
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] constexpr std::pair<handle_type, handle_type> equal_range_handle(const K& key) const noexcept{
+			return {lower_bound_handle(key), upper_bound_handle(key)};
+		}
+
+		// Iterator versions, positioned so ++/-- continue from there in O(1) amortized
+		[[nodiscard]] constexpr const_inorder_iterator lower_bound(const value_type& key) const noexcept{ return lower_bound_iter_(key); }
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] constexpr const_inorder_iterator lower_bound(const K& key) const noexcept{ return lower_bound_iter_(key); }
+
+		[[nodiscard]] constexpr const_inorder_iterator upper_bound(const value_type& key) const noexcept{ return upper_bound_iter_(key); }
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] constexpr const_inorder_iterator upper_bound(const K& key) const noexcept{ return upper_bound_iter_(key); }
+
+		[[nodiscard]] constexpr std::pair<const_inorder_iterator, const_inorder_iterator> equal_range(const value_type& key) const noexcept{
+			return {lower_bound(key), upper_bound(key)};
+		}
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] constexpr std::pair<const_inorder_iterator, const_inorder_iterator> equal_range(const K& key) const noexcept{
+			return {lower_bound(key), upper_bound(key)};
+		}
+
+		// Batch lookup: out[i] = find_handle(keys[i]), returns the number of hits.
+		// Runs batch_lanes searches in lock-step and prefetches each one's next slot, so their
+		// cache misses overlap instead of queueing up behind each other on trees larger than cache.
+		size_type find_handles(std::span<const value_type> keys, std::span<handle_type> out) const noexcept{
+			return find_handles_(keys, out);
+		}
+		template<class K> requires detail::transparent<Compare>
+		size_type find_handles(std::span<const K> keys, std::span<handle_type> out) const noexcept{
+			return find_handles_(keys, out);
+		}
+
+		// Batch membership: out[i] = contains(keys[i]), returns the number of hits.
+		size_type contains_batch(std::span<const value_type> keys, std::span<bool> out) const noexcept{
+			return contains_batch_(keys, out);
+		}
+		template<class K> requires detail::transparent<Compare>
+		size_type contains_batch(std::span<const K> keys, std::span<bool> out) const noexcept{
+			return contains_batch_(keys, out);
+		}
+
+		// Visit every element in [lo, hi) in order: one descent to lo, then a walk that stops at hi.
+		// Subtrees entirely outside the range are never touched.
+		template<class F>
+		constexpr void for_each_in_range(const value_type& lo, const value_type& hi, F&& f) const{ for_each_in_range_(lo, hi, f); }
+		template<class K, class F> requires detail::transparent<Compare>
+		constexpr void for_each_in_range(const K& lo, const K& hi, F&& f) const{ for_each_in_range_(lo, hi, f); }
+
+		// order statistics, O(log n) with order_statistics_policy
+		// the k-th smallest element (0-based), or end() if k >= size()
+		[[nodiscard]] constexpr const_inorder_iterator nth(size_type k) const noexcept requires has_sizes{
+			const_inorder_iterator it(this, true);
+			size_type before = 0; // elements left of the current subtree
+			it.seek_([&](index_type i){
+				const size_type r = before + count_of_(slots_[i].left);
+				if(r >= k) return true;
+				before = r + 1;
+				return false;
+				});
+			return it;
+		}
+
+		// number of elements ordered before key
+		[[nodiscard]] constexpr size_type rank(const value_type& key) const noexcept requires has_sizes{ return rank_(key); }
+		template<class K> requires (detail::transparent<Compare> && has_sizes)
+		[[nodiscard]] constexpr size_type rank(const K& key) const noexcept{ return rank_(key); }
+
+		// number of elements in [lo, hi)
+		[[nodiscard]] constexpr size_type count(const value_type& lo, const value_type& hi) const noexcept requires has_sizes{
+			return count_(lo, hi);
+		}
+		template<class K> requires (detail::transparent<Compare> && has_sizes)
+		[[nodiscard]] constexpr size_type count(const K& lo, const K& hi) const noexcept{ return count_(lo, hi); }
+
+		// aggregates, with augment_policy. Monoid::combine over all elements, or those in [lo, hi), in order
+		[[nodiscard]] constexpr aggregate_type aggregate() const noexcept requires has_aggregate{ return agg_of_(root_idx_); }
+		[[nodiscard]] constexpr aggregate_type aggregate(const value_type& lo, const value_type& hi) const noexcept requires has_aggregate{
+			return aggregate_(lo, hi);
+		}
+		template<class K> requires (detail::transparent<Compare> && has_aggregate)
+		[[nodiscard]] constexpr aggregate_type aggregate(const K& lo, const K& hi) const noexcept{ return aggregate_(lo, hi); }
+
+		// in-order visit of the elements whose lifted value satisfies keep(const aggregate_type&), skipping every
+		// subtree whose aggregate fails it. keep must be monotone: if it fails for a subtree, it fails for each part.
+		// The overload taking hi also stops at the first key not below hi (interval overlap: keys are starts,
+		// aggregate the max end, keep = max_end > query_lo, hi = query_hi).
+		template<class Keep, class F> requires has_aggregate
+		constexpr void for_each_pruned(Keep&& keep, F&& f) const{ for_each_pruned_([](index_type){ return true; }, keep, f); }
+		template<class Keep, class F> requires has_aggregate
+		constexpr void for_each_pruned(const value_type& hi, Keep&& keep, F&& f) const{ for_each_pruned_below_(hi, keep, f); }
+		template<class K, class Keep, class F> requires (detail::transparent<Compare> && has_aggregate)
+		constexpr void for_each_pruned(const K& hi, Keep&& keep, F&& f) const{ for_each_pruned_below_(hi, keep, f); }
+
+		// recompute the aggregates above a value changed in place (e.g. through flat::map); false for stale handles
+		constexpr bool refresh(handle_type h) noexcept requires has_aggregate{
+			if(!is_handle_valid(h)) return false;
+			search_path path;
+			descend_path_(slots_[Layout::unpack_index(h)].key(), path);
+			repair_path_(path, path.depth);
+			return true;
+		}
 
 		constexpr void clear() noexcept{
 			slots_.clear();
+			if constexpr(is_soa){ payloads_.clear(); }
 			root_idx_ = null_idx;
 			free_head_ = null_idx;
 			alive_count_ = 0;
+			max_count_ = 0;
+			max_hint_ = null_idx;
+			reset_maintenance_();
 		}
 
-		void swap(bst& other) noexcept{
+		constexpr void swap(bst& other) noexcept{
 			using std::swap;
-			swap(slots_, other.slots_);
-			swap(root_idx_, other.root_idx_);
-			swap(free_head_, other.free_head_);
-			swap(alive_count_, other.alive_count_);
+			swap_storage_(other);
 			swap(comp_, other.comp_);
+			swap(probes_, other.probes_);
+			swap(maint_, other.maint_);
+		}
+
+		// Write the tree in the flat::mapped_bst format (see detail::mapped_header): slots keep their
+		// positions, so handles issued by this tree resolve in the mapping too. Two passes over the slots,
+		// the first for the checksum, since the header comes first and out may not be seekable.
+		// Throws std::ios_base::failure (or leaves out failed) per the stream's exception mask.
+		void save(std::ostream& out) const requires(std::is_trivially_copyable_v<T> && !is_keyed){
+			using record = detail::mapped_slot<T, IndexT>;
+			static_assert(alignof(record) <= alignof(detail::mapped_header), "records must stay aligned after the header");
+			auto to_record = [&](const Slot& s){
+				record r;
+				r.generation = s.generation;
+				r.left = s.left;
+				r.right = s.right;
+				if(s.is_alive()) std::memcpy(&r.value, &s.stored(), sizeof(T));
+				return r;
+				};
+			detail::mapped_header h;
+			std::memset(&h, 0, sizeof(h));
+			std::memcpy(h.magic, detail::mapped_header::magic_value, sizeof(h.magic));
+			h.version = detail::mapped_header::current_version;
+			h.byte_order = detail::mapped_header::byte_order_mark;
+			h.index_bytes = sizeof(IndexT);
+			h.value_bytes = sizeof(T);
+			h.value_align = alignof(T);
+			h.record_bytes = sizeof(record);
+			h.slot_count = slots_.size();
+			h.alive_count = alive_count_;
+			h.root = root_idx_;
+			h.free_head = free_head_;
+			h.checksum = detail::fnv1a_seed;
+			for(const Slot& s : slots_){
+				const record r = to_record(s);
+				h.checksum = detail::fnv1a(&r, sizeof(r), h.checksum);
+			}
+			out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+			// batch records into ~16 KiB stream writes
+			const size_type per_chunk = std::max<size_type>(1, (16u << 10) / sizeof(record));
+			auto chunk = scratch_<record>();
+			chunk.reserve(per_chunk);
+			auto flush = [&]{
+				out.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(chunk.size() * sizeof(record)));
+				chunk.clear();
+				};
+			for(const Slot& s : slots_){
+				chunk.push_back(to_record(s));
+				if(chunk.size() == per_chunk) flush();
+			}
+			flush();
+		}
+
+		// Immutable, link-free copy of the current contents for read-only lookups.
+		[[nodiscard]] frozen_bst<T, Compare> freeze() const requires(!is_keyed){
+			auto sorted = scratch_<const value_type*>();
+			sorted.reserve(alive_count_);
+			for_each_inorder([&](const value_type& v){ sorted.push_back(&v); });
+			frozen_bst<T, Compare> out(comp_);
+			out.assign_(sorted.size(), [&](size_type rank) -> const value_type&{ return *sorted[rank]; });
+			return out;
 		}
 
 		// Note: This INVALIDATES all existing external handles.
-		constexpr void rebuild_balanced(){
+		// values are moved into the new slots when that cannot throw, otherwise copied, so a throwing copy
+		// leaves the tree intact. Peak memory is two slot arrays, never two copies of what the values own.
+		constexpr void rebuild_balanced(layout order = layout::preorder){
 			if(alive_count_ < 2) return;
-			std::vector<value_type> vals;
-			vals.reserve(alive_count_);
-			for_each_inorder([&](const value_type& v){ vals.push_back(v); });
-			bst tmp(comp_);
-			tmp.build_from_sorted_unique_into_empty(vals.begin(), vals.end());
-			swap(tmp);
+			const auto sorted = inorder_indices_();
+			bst tmp(comp_, get_allocator());
+			tmp.build_balanced_into_empty_(sorted.size(), [&](size_type rank) -> decltype(auto){
+				return std::move_if_noexcept(value_at_(sorted[rank]));
+				}, order);
+			swap_storage_(tmp);
+		}
+
+		// Pack live nodes contiguously in `order`, drop the free-list holes and shrink the storage to fit.
+		// This INVALIDATES all existing external handles: on_relocate(old_handle, new_handle) runs once
+		// per element afterwards, so external indexes can be patched instead of thrown away.
+		// values are moved when that cannot throw, otherwise copied, so a throwing copy leaves the tree intact.
+		template<class F> requires std::invocable<F&, handle_type, handle_type>
+		constexpr void rebuild_compact(F&& on_relocate, layout order = layout::preorder){
+			auto old_order = scratch_<index_type>();
+			old_order.reserve(alive_count_);
+			auto new_order = scratch_<index_type>();
+			new_order.reserve(alive_count_); // before any value moves, so a failed allocation leaves the tree intact
+			collect_inorder_(root_idx_, old_order);
+			bst tmp(comp_, get_allocator());
+			tmp.build_balanced_into_empty_(old_order.size(), [&](size_type rank) -> decltype(auto){
+				return std::move_if_noexcept(value_at_(old_order[rank]));
+				}, order);
+			tmp.slots_.shrink_to_fit();
+			if constexpr(is_soa){ tmp.payloads_.shrink_to_fit(); }
+			tmp.collect_inorder_(tmp.root_idx_, new_order);
+			swap_storage_(tmp);
+			for(size_type r = 0; r < new_order.size(); ++r){
+				on_relocate(tmp.make_handle(old_order[r]), make_handle(new_order[r]));
+			}
+		}
+
+		// as above, collecting the relocations into a table: remap[old_handle] == new_handle.
+		// The table comes from the tree's allocator (inline on inline_policy trees)
+		handle_remap rebuild_compact(layout order = layout::preorder){
+			auto entries = scratch_<typename handle_remap::entry>();
+			entries.reserve(slots_.size());
+			for(size_type i = 0; i < slots_.size(); ++i){ entries.push_back({npos, npos}); }
+			handle_remap remap(std::move(entries));
+			rebuild_compact([&](handle_type from, handle_type to){
+				remap.entries_[Layout::unpack_index(from)] = {from, to};
+				++remap.count_;
+				}, order);
+			return remap;
+		}
+
+		// An element taken out by extract(): owns the value until insert(node_type&&) hands it to a tree,
+		// this one or another of the same type, so values change trees by moves alone
+		class node_type final{
+		public:
+			constexpr node_type() noexcept = default;
+			[[nodiscard]] constexpr bool empty() const noexcept{ return !value_.has_value(); }
+			constexpr explicit operator bool() const noexcept{ return value_.has_value(); }
+			[[nodiscard]] constexpr value_type& value() noexcept{ assert(!empty()); return *value_; }
+			[[nodiscard]] constexpr const value_type& value() const noexcept{ assert(!empty()); return *value_; }
+		private:
+			friend class bst;
+			std::optional<value_type> value_;
+		};
+		// insert(node_type&&): on a duplicate the node comes back untouched, as with std::set
+		struct insert_return_type final{
+			handle_type handle = npos;
+			bool inserted = false;
+			node_type node;
+		};
+
+		// unlink the element at h and move its value into the returned node, empty for a stale handle.
+		// Other handles stay valid, as with erase()
+		constexpr node_type extract(handle_type h){
+			node_type out;
+			if(!is_handle_valid(h)) return out;
+			const index_type i = Layout::unpack_index(h);
+			// search with the key still in place, take the value just before the node is unlinked and freed
+			[[maybe_unused]] const bool found = erase_key_(slots_[i].key(), [&](index_type hit){
+				assert(hit == i);
+				out.value_.emplace(std::move_if_noexcept(value_at_(hit)));
+				});
+			assert(found);
+			return out;
+		}
+		constexpr insert_return_type insert(node_type&& node){
+			if(node.empty()) return {};
+			const auto [h, inserted] = insert_with_(std::as_const(*node.value_), [&]{ return allocate_node(std::move(*node.value_)); });
+			if(!inserted) return {h, false, std::move(node)};
+			node.value_.reset();
+			return {h, true, {}};
 		}
 
 		// insert / emplace, returns {index, inserted}
 		constexpr std::pair<handle_type, bool> insert(const value_type& v){ return insert_impl(v); }
 		constexpr std::pair<handle_type, bool> insert(value_type&& v){ return insert_impl(std::move(v)); }
 
+		// constructs straight into a slot, then searches with the new node's own key. on a duplicate
+		// the node is freed again, so the cost of a miss is one construction and no move.
 		template<class... Args>
 		constexpr std::pair<handle_type, bool> emplace(Args&&... args){
-			value_type temp(std::forward<Args>(args)...);
-			return insert_impl(std::move(temp));
+			return emplace_hint(npos, std::forward<Args>(args)...);
 		}
 
-		template<class It>
-		size_type insert(It first, It last){
+		// hinted inserts: hint is the handle of the previous largest element, typically the last result when
+		// appending in order. The hint is honoured ONLY for appends: if hint is still the largest element and
+		// the new key orders after it, the node hangs straight off it in O(1). Any other hint is ignored and
+		// this is a plain insert with a full descent (slots keep no parent links, so a hint in the middle
+		// cannot find its successor locally), as it always is on AVL and scapegoat trees, which need the
+		// full path to rebalance, and under maintenance_policy, which needs the depth.
+		constexpr std::pair<handle_type, bool> insert(handle_type hint, const value_type& v){
+			return insert_hinted_(hint, v, [&]{ return allocate_node(v); });
+		}
+		constexpr std::pair<handle_type, bool> insert(handle_type hint, value_type&& v){
+			// Important: don't move from v during comparisons
+			return insert_hinted_(hint, std::as_const(v), [&]{ return allocate_node(std::move(v)); });
+		}
+
+		template<class... Args>
+		constexpr std::pair<handle_type, bool> emplace_hint(handle_type hint, Args&&... args){
+			const index_type idx = allocate_node(std::forward<Args>(args)...);
+			bool linked = false; // make() runs right before the node is linked
+			try{
+				const auto r = insert_hinted_(hint, std::as_const(slots_[idx].key()), [&]{ linked = true; return idx; });
+				if(!r.second) free_node(idx);
+				return r;
+			} catch(...){
+				// a throwing Compare leaves no unlinked node behind. Once linked the node stays: what throws
+				// after that (a maintenance callback, a relink's scratch buffer) leaves it a valid element
+				if(!linked) free_node(idx);
+				throw;
+			}
+		}
+
+		template<class It> requires std::input_iterator<It>
+		constexpr size_type insert(It first, It last){
 			if constexpr(std::forward_iterator<It>){
 				auto n = static_cast<size_type>(std::distance(first, last));
 				if(n) reserve(size() + n);
@@ -303,46 +1218,298 @@ namespace flat {
 			return inserted;
 		}
 
+		// insert a range sorted by Compare, skipping values already present. existing handles stay valid.
+		// values that fall between the same two neighbours are linked in as one balanced subtree, so each
+		// such run costs a single descent: appending a sorted batch is O(log n + batch) and adds only
+		// ~log2(batch) levels instead of a chain. AVL and scapegoat trees insert one by one to keep their bound.
+		// Under maintenance_policy the deepest attached node goes through the depth trigger once per call.
+		template<class It>
+		constexpr size_type insert_sorted(It first, It last){
+			assert(std::is_sorted(first, last, value_comp_()));
+			if constexpr(is_avl || is_scapegoat){
+				return insert(first, last);
+			} else{
+				if constexpr(std::forward_iterator<It>){
+					auto n = static_cast<size_type>(std::distance(first, last));
+					if(n) reserve(size() + n);
+				}
+				size_type inserted = 0;
+				[[maybe_unused]] size_type deepest = 0;
+				[[maybe_unused]] index_type deepest_node = null_idx;
+				auto run = scratch_<index_type>();
+				while(first != last){
+					auto gap = lower_bound_iter_(*first);
+					const index_type next = gap.cur_raw_;
+					if(next != null_idx && !comp_(key_of_(*first), slots_[next].key())){ ++first; continue; } // already present
+					run.clear();
+					try{
+						for(; first != last && (next == null_idx || comp_(key_of_(*first), slots_[next].key())); ++first){
+							if(!run.empty() && !comp_(slots_[run.back()].key(), key_of_(*first))) continue; // duplicate in input
+							run.push_back(allocate_node(*first));
+						}
+					} catch(...){
+						attach_run_(gap, run); // keep what was allocated reachable
+						throw;
+					}
+					inserted += run.size();
+					attach_run_(gap, run);
+					if constexpr(has_maintenance){
+						// midpoint runs lean left: the run's first node ends its longest path
+						const size_type depth = run.empty() ? 0 : depth_of_(run.front());
+						if(depth > deepest){ deepest = depth; deepest_node = run.front(); }
+					}
+				}
+				if constexpr(has_maintenance){ if(deepest_node != null_idx) after_update_(deepest, deepest_node); }
+				return inserted;
+			}
+		}
+
 		// build balanced tree from pre-sorted-unique input. replacing any existing tree contents
 		template<class It>
 			requires std::random_access_iterator<It>
-		void build_from_sorted_unique(It first, It last){
-			assert(std::is_sorted(first, last, comp_) && "Input range must be sorted according to Compare");
-			bst tmp(comp_);
-			tmp.build_from_sorted_unique_into_empty(first, last);
-			swap(tmp);
+		constexpr void build_from_sorted_unique(It first, It last, layout order = layout::preorder){
+			assert(std::is_sorted(first, last, value_comp_()) && "Input range must be sorted according to Compare");
+			bst tmp(comp_, get_allocator());
+			tmp.build_from_sorted_unique_into_empty(first, last, order);
+			swap_storage_(tmp);
 		}
 
 		// build balanced tree from arbitrary input range (sorts + uniques)
 		template<class It>
-		void build_from_range(It first, It last){
-			std::vector<value_type> vals;
+		constexpr void build_from_range(It first, It last, layout order = layout::preorder){
+			if constexpr(is_inline){
+				// no heap and no second tree: values go straight into tmp's slots, a duplicate is dropped before it
+				// takes one (so only more than N distinct values overflow), then the slots are permuted into layout
+				bst tmp(comp_);
+				auto ranked = scratch_<index_type>(); // tmp's slots in key order
+				auto add = [&](auto&& v){
+					const auto at = std::lower_bound(ranked.begin(), ranked.end(), key_of_(v),
+						[&](index_type i, const key_type& k){ return comp_(tmp.slots_[i].key(), k); });
+					if(at != ranked.end() && !comp_(key_of_(v), tmp.slots_[*at].key())) return;
+					const auto pos = at - ranked.begin();
+					ranked.push_back(tmp.allocate_node(std::forward<decltype(v)>(v)));
+					std::rotate(ranked.begin() + pos, ranked.end() - 1, ranked.end());
+					};
+				for(; first != last; ++first){
+					auto&& in = *first;
+					if constexpr(std::is_same_v<std::remove_cvref_t<decltype(in)>, value_type>){
+						add(std::forward<decltype(in)>(in));
+					} else{
+						add(value_type(std::forward<decltype(in)>(in)));
+					}
+				}
+				tmp.place_inorder_(ranked, order);
+				swap_storage_(tmp);			} else if constexpr(!std::is_move_assignable_v<value_type>){
+				// const members (flat::map's std::pair<const Key, T>) can't be sorted in place: sort positions instead
+				auto vals = scratch_<value_type>();
+				if constexpr(std::forward_iterator<It>){
+					vals.reserve(static_cast<size_type>(std::distance(first, last)));
+				}
+				for(; first != last; ++first){ vals.push_back(*first); }
+				auto ranked = scratch_<size_type>();
+				ranked.reserve(vals.size());
+				for(size_type i = 0; i < vals.size(); ++i){ ranked.push_back(i); }
+				std::sort(ranked.begin(), ranked.end(), [&](size_type a, size_type b){ return comp_(key_of_(vals[a]), key_of_(vals[b])); });
+				ranked.erase(std::unique(ranked.begin(), ranked.end(),
+					[&](size_type a, size_type b){
+						return equiv_(vals[b], vals[a]);
+					}), ranked.end());
+				bst tmp(comp_, get_allocator());
+				tmp.build_balanced_into_empty_(ranked.size(), [&](size_type rank) -> value_type&&{ return std::move(vals[ranked[rank]]); }, order);
+				swap_storage_(tmp);
+			} else{
+				auto vals = scratch_<value_type>();
+				if constexpr(std::forward_iterator<It>){
+					vals.reserve(static_cast<size_type>(std::distance(first, last)));
+				}
+				for(; first != last; ++first){ vals.push_back(*first); }
+				std::sort(vals.begin(), vals.end(), value_comp_());
+				vals.erase(std::unique(vals.begin(), vals.end(),
+					[&](const value_type& a, const value_type& b){
+						return equiv_(b, a);
+					}), vals.end());
+				// the buffer is ours: move out of it, each value is built once from the input and moved once more
+				bst tmp(comp_, get_allocator());
+				tmp.build_balanced_into_empty_(vals.size(), [&](size_type rank) -> value_type&&{ return std::move(vals[rank]); }, order);
+				swap_storage_(tmp);
+			}
+		}
+
+#if defined(FLAT_BST_PARALLEL)
+		// Parallel builds: sorting, dedup and (for layout::preorder, whose slot positions are known up front)
+		// filling the slots run on exec, e.g. std::execution::par. As with any parallel algorithm, an exception
+		// thrown by T or Compare on a worker calls std::terminate. Other layouts link serially after the sort.
+		template<class ExecutionPolicy, class It>
+			requires (std::is_execution_policy_v<std::remove_cvref_t<ExecutionPolicy>> && !is_inline)
+		void build_from_range(ExecutionPolicy&& exec, It first, It last, layout order = layout::preorder){
+			auto vals = scratch_<value_type>();
 			if constexpr(std::forward_iterator<It>){
 				vals.reserve(static_cast<size_type>(std::distance(first, last)));
 			}
 			for(; first != last; ++first){ vals.push_back(*first); }
-			std::sort(vals.begin(), vals.end(), comp_);
-			vals.erase(std::unique(vals.begin(), vals.end(),
+			std::sort(exec, vals.begin(), vals.end(), value_comp_());
+			vals.erase(std::unique(exec, vals.begin(), vals.end(),
 				[&](const value_type& a, const value_type& b){
 					return equiv_(b, a);
 				}), vals.end());
-			build_from_sorted_unique(vals.begin(), vals.end());
+			bst tmp(comp_, get_allocator());
+			tmp.build_balanced_into_empty_(exec, vals.size(), [&](size_type rank) -> value_type&&{ return std::move(vals[rank]); }, order);
+			swap_storage_(tmp);
 		}
 
-		// erase by key - returns true if erased
-		constexpr bool erase(const value_type& key){
-			const auto r = find_path_(key);
-			if(r.cur == null_idx) return false;
-			erase_internal(r.parent, r.cur);
-			return true;
+		template<class ExecutionPolicy, class It>
+			requires (std::is_execution_policy_v<std::remove_cvref_t<ExecutionPolicy>> && !is_inline && std::random_access_iterator<It>)
+		void build_from_sorted_unique(ExecutionPolicy&& exec, It first, It last, layout order = layout::preorder){
+			assert(std::is_sorted(first, last, value_comp_()) && "Input range must be sorted according to Compare");
+			bst tmp(comp_, get_allocator());
+			tmp.build_balanced_into_empty_(exec, static_cast<size_type>(std::distance(first, last)),
+				[&](size_type rank) -> decltype(auto){ return first[static_cast<std::ptrdiff_t>(rank)]; }, order);
+			swap_storage_(tmp);
 		}
 
-	   // traversals: inorder, preorder, postorder. Callback recieves const T&
-		template<class F>
-		constexpr void for_each_inorder(F&& f) const{
-			std::vector<index_type> stack;
-			stack.reserve(traversal_stack_reserve);
-			index_type index = root_idx_;
+		// Note: This INVALIDATES all existing external handles.
+		template<class ExecutionPolicy>
+			requires (std::is_execution_policy_v<std::remove_cvref_t<ExecutionPolicy>> && !is_inline)
+		void rebuild_balanced(ExecutionPolicy&& exec, layout order = layout::preorder){
+			if(alive_count_ < 2) return;
+			const auto sorted = inorder_indices_();
+			bst tmp(comp_, get_allocator());
+			tmp.build_balanced_into_empty_(exec, sorted.size(), [&](size_type rank) -> decltype(auto){
+				return std::move_if_noexcept(value_at_(sorted[rank]));
+				}, order);
+			swap_storage_(tmp);
+		}
+#endif
+
+		// Balance the tree by relinking left/right only: no value is copied or moved and no
+		// generation is bumped, so every handle and pointer stays valid. Needs n indices of scratch.
+		constexpr void rebalance_in_place(){
+			if(root_idx_ == null_idx) return; // a single node still gets its height, size and aggregate reset
+			root_idx_ = relink_balanced_(root_idx_);
+			max_count_ = alive_count_;
+			if constexpr(has_maintenance){ maint_.too_deep = false; }
+		}
+
+		// Set algebra: one simultaneous in-order walk of both trees, then one balanced build of the result,
+		// O(n + m) with the output sized once and no per-element descents. Both trees must be ordered by
+		// equivalent comparators. The results are new trees; on equal keys the element of *this is taken.
+		[[nodiscard]] constexpr bst set_union(const bst& other, layout order = layout::preorder) const{
+			return combine_<keep_mine_ | keep_theirs_ | keep_both_>(other, alive_count_ + other.alive_count_, order);
+		}
+		[[nodiscard]] constexpr bst set_intersection(const bst& other, layout order = layout::preorder) const{
+			return combine_<keep_both_>(other, std::min(alive_count_, other.alive_count_), order);
+		}
+		[[nodiscard]] constexpr bst set_difference(const bst& other, layout order = layout::preorder) const{
+			return combine_<keep_mine_>(other, alive_count_, order);
+		}
+		[[nodiscard]] constexpr bst set_symmetric_difference(const bst& other, layout order = layout::preorder) const{
+			return combine_<keep_mine_ | keep_theirs_>(other, alive_count_ + other.alive_count_, order);
+		}
+
+		// Move the elements of other whose keys are not in this tree over, like std::set::merge: other keeps
+		// the rest. O(n + m), both trees are rebuilt balanced, which INVALIDATES the handles of both.
+		// values are moved when that cannot throw, otherwise copied.
+		constexpr void merge(bst& other, layout order = layout::preorder){
+			if(this == &other || other.empty()) return;
+			const auto mine = inorder_indices_();
+			const auto theirs = other.inorder_indices_();
+			struct pick final{ bst* from; index_type idx; };
+			auto merged = scratch_<pick>();
+			merged.reserve(mine.size() + theirs.size());
+			auto kept = scratch_<index_type>();
+			merge_walk_(other, mine, theirs, [&](index_type a, index_type b){
+				merged.push_back(a != null_idx ? pick{this, a} : pick{&other, b});
+				if(a != null_idx && b != null_idx) kept.push_back(b);
+				});
+			// both results are sized and planned before the first value moves, so a failed allocation
+			// leaves both trees as they were
+			bst out(comp_, get_allocator());
+			out.reserve(merged.size());
+			const auto out_plan = out.build_plan_(merged.size(), order);
+			bst rest(other.comp_, other.get_allocator());
+			rest.reserve(kept.size());
+			const auto rest_plan = rest.build_plan_(kept.size(), order);
+			out.build_planned_(merged.size(), [&](size_type rank) -> decltype(auto){
+				return std::move_if_noexcept(merged[rank].from->value_at_(merged[rank].idx));
+				}, order, out_plan);
+			rest.build_planned_(kept.size(), [&](size_type rank) -> decltype(auto){
+				return std::move_if_noexcept(other.value_at_(kept[rank]));
+				}, order, rest_plan);
+			swap_storage_(out);
+			other.swap_storage_(rest);
+		}
+
+		// Move the elements not less than key into the returned (balanced) tree and keep the rest in place.
+		// The kept part is unhooked along the search path, so its handles stay valid: O(depth + moved elements),
+		// plus a rebalance_in_place() of what is left on AVL and scapegoat trees.
+		// values are moved when that cannot throw, otherwise copied, so a throwing copy leaves the tree intact.
+		[[nodiscard]] constexpr bst split(const value_type& key, layout order = layout::preorder){ return split_(key, order); }
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] constexpr bst split(const K& key, layout order = layout::preorder){ return split_(key, order); }
+
+		// Append other, whose elements must all be greater than this tree's, and leave other empty. other's
+		// live values move into this tree's free slots first and are appended only once those run out, so
+		// other's holes are left behind and split/join cycles reuse storage instead of growing it. The new
+		// nodes are hung balanced below the largest element, so this tree's handles stay valid (other's do
+		// not): O(m), plus a rebalance_in_place() of the result on AVL and scapegoat trees.
+		// values are moved when that cannot throw, otherwise copied, so a throwing copy leaves both intact.
+		constexpr void join(bst& other){
+			if(this == &other) return;
+			if(other.root_idx_ == null_idx){ other.clear(); return; }
+			assert((root_idx_ == null_idx || comp_(slots_[max_index_()].key(), other.slots_[other.begin().cur_raw_].key()))
+				&& "join: other must hold only elements greater than this tree's");
+			const auto theirs = other.inorder_indices_();
+			const size_type holes = slots_.size() - alive_count_;
+			const size_type total = slots_.size() + (theirs.size() > holes ? theirs.size() - holes : 0);
+			if(total >= static_cast<size_type>(null_idx)) throw std::length_error("BST index overflow");
+			if constexpr(is_inline){ if(total > inline_capacity_) throw std::length_error("inline capacity exceeded"); }
+			reserve(total);
+			auto added = scratch_<index_type>();
+			added.reserve(theirs.size());
+			try{
+				for(const index_type i : theirs){ added.push_back(allocate_node(std::move_if_noexcept(other.value_at_(i)))); }
+			} catch(...){
+				for(const index_type i : added){ free_node(i); }
+				throw;
+			}
+			const index_type top = link_balanced_(added);
+			if(root_idx_ == null_idx) root_idx_ = top; else slots_[max_index_()].right = top;
+			max_hint_ = added.back();
+			other.clear();
+			if constexpr(is_avl || is_scapegoat){ rebalance_in_place(); }
+		}
+
+		// erase by key - returns true if erased
+		constexpr bool erase(const value_type& key){ return erase_key_(key); }
+		template<class K> requires detail::transparent<Compare>
+		constexpr bool erase(const K& key){ return erase_key_(key); }
+
+		// Bulk erase, one in-order pass over the whole tree instead of a descent per element: the doomed
+		// nodes go onto the free list and the survivors are relinked balanced in place, so their handles stay
+		// valid and a skewed tree comes out balanced. O(n), meant for erasing a sizeable share at once: a
+		// few keys are cheaper through erase(key). Follow with rebuild_compact() to drop the holes
+		// (maintenance_policy reports them, see maintenance_mode). Each returns the number of elements erased.
+
+		// pred(const value_type&) sees every element once, in order. If it throws, nothing is erased
+		template<class Pred>
+		constexpr size_type erase_if(Pred pred){
+			return erase_ranks_(inorder_indices_(), [&](size_type, index_type i){ return bool(pred(std::as_const(value_at_(i)))); });
+		}
+		// the elements in [lo, hi)
+		constexpr size_type erase_range(const value_type& lo, const value_type& hi){ return erase_range_(lo, hi); }
+		template<class K> requires detail::transparent<Compare>
+		constexpr size_type erase_range(const K& lo, const K& hi){ return erase_range_(lo, hi); }
+		// every element equivalent to one of keys, which may come in any order and repeat: O(n + m log m)
+		constexpr size_type erase(std::span<const value_type> keys){ return erase_keys_(keys); }
+		template<class K> requires detail::transparent<Compare>
+		constexpr size_type erase(std::span<const K> keys){ return erase_keys_(keys); }
+
+	   // traversals: inorder, preorder, postorder. Callback recieves const T&
+		template<class F>
+		constexpr void for_each_inorder(F&& f) const{
+			auto stack = scratch_<index_type>();
+			stack.reserve(traversal_stack_reserve);
+			index_type index = root_idx_;
 			while(index != null_idx || !stack.empty()){
 				while(index != null_idx){
 					stack.push_back(index);
@@ -350,7 +1517,7 @@ namespace flat {
 				}
 				index = stack.back();
 				stack.pop_back();
-				f(slots_[index].value());
+				f(value_at_(index));
 				index = slots_[index].right;
 			}
 		}
@@ -358,14 +1525,14 @@ namespace flat {
 		template<class F>
 		constexpr void for_each_preorder(F&& f) const{
 			if(root_idx_ == null_idx) return;
-			std::vector<index_type> stack;
+			auto stack = scratch_<index_type>();
 			stack.reserve(traversal_stack_reserve);
 			stack.push_back(root_idx_);
 			while(!stack.empty()){
 				index_type index = stack.back();
 				stack.pop_back();
 				const Slot& n = slots_[index];
-				f(n.value());
+				f(value_at_(index));
 				if(n.right != null_idx) stack.push_back(n.right);
 				if(n.left != null_idx) stack.push_back(n.left);
 			}
@@ -374,7 +1541,8 @@ namespace flat {
 		template<class F>
 		constexpr void for_each_postorder(F&& f) const{
 			if(root_idx_ == null_idx) return;
-			std::vector<index_type> stack1, stack2;
+			auto stack1 = scratch_<index_type>();
+			auto stack2 = scratch_<index_type>();
 			stack1.reserve(traversal_stack_reserve);
 			stack2.reserve(traversal_stack_reserve);
 			stack1.push_back(root_idx_);
@@ -387,38 +1555,80 @@ namespace flat {
 				if(n.right != null_idx) stack1.push_back(n.right);
 			}
 			while(!stack2.empty()){
-				f(slots_[stack2.back()].value());
+				f(value_at_(stack2.back()));
 				stack2.pop_back();
 			}
 		}
 
+		// unordered: every live value in slot order. A linear sweep over storage instead of a pointer chase,
+		// for scans where the key order does not matter.
+		template<class F>
+		constexpr void for_each_slot(F&& f) const{
+			for(size_type i = 0; i < slots_.size(); ++i){
+				if(slots_[i].is_alive()) f(value_at_(static_cast<index_type>(i)));
+			}
+		}
+
+#if defined(FLAT_BST_PARALLEL)
+		// for_each_slot split across exec: f runs concurrently on the live values, in no particular order
+		template<class ExecutionPolicy, class F>
+			requires std::is_execution_policy_v<std::remove_cvref_t<ExecutionPolicy>>
+		void parallel_for_each(ExecutionPolicy&& exec, F&& f) const{
+			std::for_each(exec, slots_.begin(), slots_.end(), [&](const Slot& s){
+				if(s.is_alive()) f(value_at_(index_of_(s)));
+				});
+		}
+
+		// reduce(..., transform(v)) over the live values on exec. Dead slots contribute identity, which is
+		// also the initial value, and since slots are combined in storage order reduce must be associative
+		// and commutative (as for std::transform_reduce).
+		template<class ExecutionPolicy, class R, class Reduce, class Transform>
+			requires std::is_execution_policy_v<std::remove_cvref_t<ExecutionPolicy>>
+		[[nodiscard]] R parallel_reduce(ExecutionPolicy&& exec, R identity, Reduce reduce, Transform transform) const{
+			return std::transform_reduce(exec, slots_.begin(), slots_.end(), identity, reduce, [&](const Slot& s) -> R{
+				return s.is_alive() ? R(transform(value_at_(index_of_(s)))) : identity;
+				});
+		}
+#endif
+
 	private:	
 
 		struct Slot final{
 			// Generation logic: Even = Alive, Odd = Free.
+			// Only the low Layout::gen_bits are the generation, the bits above hold the AVL subtree height.
 			index_type generation = Layout::wrap_gen(1);
 			index_type left = null_idx;
 			index_type right = null_idx; // Acts as next_free when dead
+			[[no_unique_address]] std::conditional_t<has_sizes, index_type, detail::none> count{}; // order statistics: nodes in this subtree
+			[[no_unique_address]] aggregate_type agg{}; // augment_policy: Monoid over this subtree
 
-			alignas(T) std::byte storage[sizeof(T)];
+			// the value, or its key under soa_policy. stored_ is constructed only while alive; a union, unlike raw bytes,
+			// stays usable in constant expressions, and the empty vacant_ keeps unused slots initialized for those
+			using stored_type = std::conditional_t<is_soa, key_type, value_type>;
+			union{ detail::none vacant_; stored_type stored_; };
 
+			constexpr index_type gen() const noexcept{ return Layout::wrap_gen(generation); }
 			constexpr bool is_alive() const noexcept{ return (generation % 2) == 0; }
 			constexpr void bump_generation() noexcept{
-				generation = Layout::wrap_gen(generation + 1);
+				generation = static_cast<index_type>((generation & static_cast<index_type>(~Layout::gen_value_mask)) | Layout::wrap_gen(generation + 1));
+			}
+			constexpr index_type height() const noexcept{ return generation >> Layout::gen_bits; }
+			constexpr void set_height(index_type h) noexcept{
+				generation = static_cast<index_type>((h << Layout::gen_bits) | gen());
 			}
 			template<typename... Args>
 			constexpr void construct_value(Args&&... args){
-				std::construct_at(reinterpret_cast<T*>(storage), std::forward<Args>(args)...);
+				std::construct_at(std::addressof(stored_), std::forward<Args>(args)...);
 			}
 
 			constexpr void destroy_value() noexcept{
-				std::destroy_at(std::launder(reinterpret_cast<T*>(storage)));
+				std::destroy_at(std::addressof(stored_));
 			}
 
-			template<class V>
-			void revive(V&& v){
+			template<class... Args>
+			constexpr void revive(Args&&... args){
 				assert(!is_alive());
-				construct_value(std::forward<V>(v)); // may throw
+				construct_value(std::forward<Args>(args)...); // may throw
 				bump_generation(); // odd -> even
 				left = null_idx;
 				right = null_idx;
@@ -428,68 +1638,84 @@ namespace flat {
 				assert(is_alive());
 				destroy_value();
 				bump_generation();  // even -> odd
+				set_height(0);
 				left = null_idx;
 				right = next_free;
 			}
 
-			constexpr T& value() noexcept{ return *std::launder(reinterpret_cast<T*>(storage)); }
-			constexpr const T& value() const noexcept{ return *std::launder(reinterpret_cast<const T*>(storage)); }
+			constexpr stored_type& stored() noexcept{ return stored_; }
+			constexpr const stored_type& stored() const noexcept{ return stored_; }
+			// what Compare orders: the stored key, or under key_policy the key inside the stored value
+			constexpr const key_type& key() const noexcept{
+				if constexpr(is_keyed && !is_soa){ return std::invoke(typename Policy::key_of{}, stored_); } else{ return stored_; }
+			}
 
 			// RAII: ensure Slot copies/moves only the live T, and destroys when needed.
-			Slot() = default;
+			constexpr Slot() noexcept : vacant_{}{}
 
-			explicit Slot(std::in_place_t, auto&&... args)
+			constexpr explicit Slot(std::in_place_t, auto&&... args)
 				: generation(2), left(null_idx), right(null_idx){
-				std::construct_at(reinterpret_cast<T*>(storage), std::forward<decltype(args)>(args)...);
+				construct_value(std::forward<decltype(args)>(args)...);
 			}
 
-			Slot(const Slot& other)
-				noexcept(std::is_nothrow_copy_constructible_v<T>)
-				: generation(other.generation), left(other.left), right(other.right){
+			constexpr Slot(const Slot& other)
+				noexcept(std::is_nothrow_copy_constructible_v<stored_type>)
+				: generation(other.generation), left(other.left), right(other.right), count(other.count), agg(other.agg), vacant_{}{
 				if(other.is_alive()){
-					construct_value(other.value());
+					construct_value(other.stored());
 				}
 			}
 
-			Slot(Slot&& other)
-				noexcept(std::is_nothrow_move_constructible_v<T>)
-				: generation(other.generation), left(other.left), right(other.right){
+			constexpr Slot(Slot&& other)
+				noexcept(std::is_nothrow_move_constructible_v<stored_type>)
+				: generation(other.generation), left(other.left), right(other.right), count(other.count), agg(other.agg), vacant_{}{
 				if(other.is_alive()){
-					construct_value(std::move(other.value())); //note: we leave other alive, with a moved-from value.		
+					construct_value(std::move(other.stored())); //note: we leave other alive, with a moved-from value.		
 				}				
 			}
 
-			friend void swap(Slot& a, Slot& b)
+			friend constexpr void swap(Slot& a, Slot& b)
 				noexcept(
-					std::is_nothrow_move_constructible_v<T> &&
-					noexcept(std::swap(std::declval<T&>(), std::declval<T&>()))
+					std::is_nothrow_move_constructible_v<stored_type> &&
+					(!std::is_swappable_v<stored_type> || std::is_nothrow_swappable_v<stored_type>)
 					){
 				using std::swap;
 				const bool a_alive = a.is_alive();
 				const bool b_alive = b.is_alive();
 
 				if(a_alive && b_alive){
-					swap(a.value(), b.value());
+					if constexpr(std::is_swappable_v<stored_type>){
+						swap(a.stored(), b.stored());
+					} else{ // const members, e.g. std::pair<const Key, T>: swap by reconstruction
+						stored_type tmp(std::move(a.stored()));
+						a.destroy_value();
+						a.construct_value(std::move(b.stored()));
+						b.destroy_value();
+						b.construct_value(std::move(tmp));
+					}
 				} else if(a_alive && !b_alive){
-					b.construct_value(std::move(a.value()));
+					b.construct_value(std::move(a.stored()));
 					a.destroy_value();
 				} else if(!a_alive && b_alive){
-					a.construct_value(std::move(b.value()));
+					a.construct_value(std::move(b.stored()));
 					b.destroy_value();
 				} // else: both dead
 
 				swap(a.generation, b.generation);
 				swap(a.left, b.left);
 				swap(a.right, b.right);
+				swap(a.count, b.count);
+				swap(a.agg, b.agg);
 			}
 
 			// One assignment operator handles both copy and move assignment.
-			Slot& operator=(Slot other) noexcept(noexcept(swap(*this, other))){
+			constexpr Slot& operator=(Slot other) noexcept(std::is_nothrow_move_constructible_v<stored_type> && (!std::is_swappable_v<stored_type> || std::is_nothrow_swappable_v<stored_type>)){
+				using std::swap; // block scope, so ADL still finds the friend rather than bst::swap
 				swap(*this, other);
 				return *this;
 			}
 
-			~Slot() noexcept{
+			constexpr ~Slot() noexcept{
 				if(is_alive()){
 					destroy_value();
 				}
@@ -498,22 +1724,192 @@ namespace flat {
 
 		static constexpr size_type traversal_stack_reserve = 16; // Typical traversal depth (balanced trees rarely exceed log2(N). Just a perf hint, does not affect correctness.		
 		static constexpr handle_type null_idx = Layout::idx_mask; // Internal raw-index sentinel: reserve the all-ones "index field" value for npos_raw, so raw indices are always in [0, npos_raw).
-		std::vector<Slot> slots_;
+		scratch_vector_<Slot> slots_;
+		struct no_payloads final{ constexpr void swap(no_payloads&) noexcept{} };
+		[[no_unique_address]] std::conditional_t<is_soa, scratch_vector_<std::optional<value_type>>, no_payloads> payloads_; // soa: values by slot index
 		index_type root_idx_ = null_idx;
 		index_type free_head_ = null_idx;
 		size_type alive_count_ = 0;
+		size_type max_count_ = 0; // scapegoat: largest size since the last full rebuild
+		index_type max_hint_ = null_idx; // the largest element, or null_idx when unknown. links below it never change who it is
 		[[no_unique_address]] Compare comp_{};
+		[[no_unique_address]] std::conditional_t<counts_probes, detail::mutable_box<probe_counters>, detail::none> probes_{}; // counting_policy
+		struct maintenance_state_ final{
+			bool too_deep = false; // an insert went too deep since the last repair
+			maintenance_reason reported = maintenance_reason::none; // what on_due already heard about
+			std::function<void(maintenance_reason)> on_due;
+		};
+		[[no_unique_address]] std::conditional_t<has_maintenance, maintenance_state_, detail::none> maint_{}; // maintenance_policy
+
+		// everything but the comparator and the per-tree bookkeeping (counters, maintenance callback),
+		// for rebuilds that assemble a new tree in a temporary
+		constexpr void swap_storage_(bst& other) noexcept{
+			using std::swap;
+			swap(slots_, other.slots_);
+			swap(payloads_, other.payloads_);
+			swap(root_idx_, other.root_idx_);
+			swap(free_head_, other.free_head_);
+			swap(alive_count_, other.alive_count_);
+			swap(max_count_, other.max_count_);
+			swap(max_hint_, other.max_hint_);
+			reset_maintenance_();
+		}
+
+		constexpr void reset_maintenance_() noexcept{
+			if constexpr(has_maintenance){
+				maint_.too_deep = false;
+				maint_.reported = maintenance_reason::none;
+			}
+		}
+
+		// every free slot is on the free list, so this is O(1)
+		constexpr bool fragmented_() const noexcept requires has_maintenance{
+			const size_type total = slots_.size();
+			return total >= Policy::maintenance::min_size
+				&& static_cast<double>(total - alive_count_) > Policy::maintenance::max_free_ratio * static_cast<double>(total);
+		}
+
+		// maintenance_policy: after inserting node at depth (0 when not tracked), or after an erase (node == null_idx),
+		// record what tripped, repair depth in the automatic modes and report whatever is still due and new.
+		// Nothing here compacts: that would invalidate handles the caller cannot remap
+		constexpr void after_update_([[maybe_unused]] size_type depth, [[maybe_unused]] index_type node){
+			if constexpr(has_maintenance){
+				using M = typename Policy::maintenance;
+				if(alive_count_ >= M::min_size && static_cast<double>(depth) > M::max_depth_factor * std::bit_width(alive_count_)){
+					maint_.too_deep = true;
+				}
+				if constexpr(M::mode != maintenance_mode::notify){
+					if(node != null_idx && maint_.too_deep){
+						if constexpr(M::mode == maintenance_mode::amortized){ relink_scapegoat_(node); } else{ rebalance_in_place(); }
+						maint_.too_deep = false;
+					}
+				}
+				const maintenance_reason due = maintenance_due();
+				const maintenance_reason fresh = static_cast<maintenance_reason>(uint8_t(due) & ~uint8_t(maint_.reported));
+				maint_.reported = due;
+				if(fresh != maintenance_reason::none && maint_.on_due) maint_.on_due(fresh);
+			}
+		}
+
+		// relink the lowest ancestor of the too-deep node whose child on the path holds more than alpha of it.
+		// depth > log_{1/alpha}(n) guarantees one exists, and the sibling counts cost no more than the relink
+		constexpr void relink_scapegoat_(index_type node){
+			auto path = scratch_<index_type>();
+			for(index_type i = root_idx_; i != node; i = comp_(slots_[node].key(), slots_[i].key()) ? slots_[i].left : slots_[i].right){
+				path.push_back(i);
+			}
+			const double alpha = std::exp2(-1.0 / Policy::maintenance::max_depth_factor);
+			index_type child = node;
+			size_type child_size = 1;
+			for(size_type d = path.size(); d-- > 0;){
+				const index_type x = path[d];
+				const index_type sibling = (slots_[x].left == child) ? slots_[x].right : slots_[x].left;
+				const size_type size = 1 + child_size + count_nodes_(sibling);
+				if(static_cast<double>(child_size) > alpha * static_cast<double>(size)){
+					relink_child(d > 0 ? path[d - 1] : null_idx, x, relink_balanced_(x));
+					return;
+				}
+				child = x;
+				child_size = size;
+			}
+		}
+
+		// nodes on the search path from the root down to i, i included
+		constexpr size_type depth_of_(index_type i) const noexcept{
+			size_type depth = 1;
+			for(index_type cur = root_idx_; cur != i; cur = comp_(slots_[i].key(), slots_[cur].key()) ? slots_[cur].left : slots_[cur].right){ ++depth; }
+			return depth;
+		}
+
+		// iterative, unlike subtree_size_: unbalanced subtrees can be arbitrarily deep
+		constexpr size_type count_nodes_(index_type i) const{
+			size_type n = 0;
+			auto stack = scratch_<index_type>();
+			if(i != null_idx) stack.push_back(i);
+			while(!stack.empty()){
+				const Slot& s = slots_[stack.back()];
+				stack.pop_back();
+				++n;
+				if(s.left != null_idx) stack.push_back(s.left);
+				if(s.right != null_idx) stack.push_back(s.right);
+			}
+			return n;
+		}
+
+		// counting_policy hooks, nothing without it
+		constexpr void note_search_() const noexcept{
+			if constexpr(counts_probes){ ++probes_.value.searches; }
+		}
+		constexpr void note_visit_([[maybe_unused]] size_type comparisons) const noexcept{
+			if constexpr(counts_probes){
+				++probes_.value.nodes_visited;
+				probes_.value.comparisons += comparisons;
+			}
+		}
 
 		constexpr bool free_head_is_valid() const noexcept{
 			return free_head_ == null_idx || !slots_[free_head_].is_alive();
 		}
 
+		// temporary buffers come from the same allocator as the slots
+		template<class U>
+		constexpr scratch_vector_<U> scratch_() const noexcept{
+			if constexpr(is_inline){ return scratch_vector_<U>{}; } else{ return scratch_vector_<U>(alloc_for_<U>(slots_.get_allocator())); }
+		}
+
 		constexpr handle_type make_handle(index_type raw_idx) const noexcept{
-			return Layout::pack(raw_idx, slots_[raw_idx].generation);
+			return Layout::pack(raw_idx, slots_[raw_idx].gen());
 		}
 
-		template<class V>
-		index_type allocate_node(V&& v){
+		constexpr value_type& value_at_(index_type i) noexcept{
+			if constexpr(is_soa){ return *payloads_[i]; } else{ return slots_[i].stored(); }
+		}
+		constexpr const value_type& value_at_(index_type i) const noexcept{
+			if constexpr(is_soa){ return *payloads_[i]; } else{ return slots_[i].stored(); }
+		}
+
+		// the key a probe is compared by: projected for value_type under soa_policy and key_policy, otherwise the probe itself
+		template<class K>
+		static constexpr decltype(auto) key_of_(const K& probe) noexcept{
+			if constexpr(is_keyed && std::is_same_v<K, value_type>){
+				return std::invoke(typename Policy::key_of{}, probe);
+			} else{
+				return (probe);
+			}
+		}
+
+		// orders whole values, for the std:: algorithms
+		constexpr auto value_comp_() const noexcept{
+			return [this](const value_type& a, const value_type& b){ return comp_(key_of_(a), key_of_(b)); };
+		}
+
+		// construct a value in place from args, in a free or new slot. The node is not linked yet.
+		template<class... Args>
+		constexpr index_type allocate_node(Args&&... args){
+			if constexpr(is_soa){
+				// the value goes where allocate_slot_ will put its key: the free-list head, or the end
+				const index_type idx = free_head_ != null_idx ? free_head_ : static_cast<index_type>(slots_.size());
+				const bool fresh = idx == payloads_.size();
+				if(fresh){
+					payloads_.emplace_back(std::in_place, std::forward<Args>(args)...);
+				} else{
+					payloads_[idx].emplace(std::forward<Args>(args)...);
+				}
+				try{
+					[[maybe_unused]] const index_type same = allocate_slot_(key_of_(*payloads_[idx])); // copies the key
+					assert(same == idx);
+				} catch(...){
+					if(fresh){ payloads_.pop_back(); } else{ payloads_[idx].reset(); }
+					throw;
+				}
+				return idx;
+			} else{
+				return allocate_slot_(std::forward<Args>(args)...);
+			}
+		}
+
+		template<class... Args>
+		constexpr index_type allocate_slot_(Args&&... args){
 			assert(free_head_is_valid());
 			index_type idx;
 			if(free_head_ != null_idx){
@@ -521,7 +1917,7 @@ namespace flat {
 				Slot& s = slots_[idx];
 				free_head_ = s.right; //pop             
 				try{
-					s.revive(std::forward<V>(v));
+					s.revive(std::forward<Args>(args)...);
 				} catch(...){
 					s.right = free_head_; //push back (restore freelist)
 					free_head_ = idx;
@@ -530,7 +1926,7 @@ namespace flat {
 			} else{
 				auto next = slots_.size();
 				if(next >= static_cast<size_t>(null_idx)) throw std::length_error("BST index overflow");				
-				slots_.emplace_back(std::in_place, std::forward<V>(v));
+				slots_.emplace_back(std::in_place, std::forward<Args>(args)...);
 				idx = static_cast<index_type>(next);
 			}
 			++alive_count_;
@@ -538,66 +1934,427 @@ namespace flat {
 			return idx;
 		}
 
-		void free_node(index_type idx){
+		constexpr void free_node(index_type idx){
 			assert(free_head_is_valid());
+			if(idx == max_hint_) max_hint_ = null_idx;
 			slots_[idx].make_free(free_head_);
+			if constexpr(is_soa){ payloads_[idx].reset(); }
 			free_head_ = idx;
 			alive_count_--;
 			assert(free_head_is_valid());
 		}
 		
+		template<class K>
+		constexpr bool contains_(const K& key) const noexcept{
+			return find_path_(key).cur != null_idx;
+		}
+
+		template<class K>
+		constexpr handle_type find_handle_(const K& key) const noexcept{
+			const auto r = find_path_(key);
+			return (r.cur == null_idx) ? npos : make_handle(r.cur);
+		}
+
+		template<class K>
+		constexpr const value_type* find_ptr_(const K& key) const noexcept{
+			const auto r = find_path_(key);
+			return (r.cur == null_idx) ? nullptr : &value_at_(r.cur);
+		}
+
+		constexpr handle_type to_handle_(index_type raw) const noexcept{
+			return (raw == null_idx) ? npos : make_handle(raw);
+		}
+
+		template<class K>
+		constexpr index_type lower_bound_raw_(const K& probe) const noexcept{
+			const auto& key = key_of_(probe);
+			index_type cur = root_idx_;
+			index_type best = null_idx;
+			while(cur != null_idx){
+				const Slot& s = slots_[cur];
+				if(!comp_(s.key(), key)){
+					best = cur;
+					cur = s.left;
+				} else{
+					cur = s.right;
+				}
+			}
+			return best;
+		}
+
+		template<class K>
+		constexpr index_type upper_bound_raw_(const K& probe) const noexcept{
+			const auto& key = key_of_(probe);
+			index_type cur = root_idx_;
+			index_type best = null_idx;
+			while(cur != null_idx){
+				const Slot& s = slots_[cur];
+				if(comp_(key, s.key())){
+					best = cur;
+					cur = s.left;
+				} else{
+					cur = s.right;
+				}
+			}
+			return best;
+		}
+
+		template<class K>
+		constexpr const_inorder_iterator lower_bound_iter_(const K& key) const noexcept{
+			const_inorder_iterator it(this, true);
+			it.seek_([&](index_type i){ return !comp_(slots_[i].key(), key_of_(key)); });
+			return it;
+		}
+
+		template<class K>
+		constexpr const_inorder_iterator upper_bound_iter_(const K& key) const noexcept{
+			const_inorder_iterator it(this, true);
+			it.seek_([&](index_type i){ return comp_(key_of_(key), slots_[i].key()); });
+			return it;
+		}
+
+		template<class K, class F>
+		constexpr void for_each_in_range_(const K& lo, const K& hi, F& f) const{
+			for(auto it = lower_bound_iter_(lo); it != end() && comp_(slots_[it.cur_raw_].key(), key_of_(hi)); ++it){
+				f(*it);
+			}
+		}
+
+		template<class K>
+		constexpr aggregate_type aggregate_(const K& lo_probe, const K& hi_probe) const noexcept{
+			const typename Policy::augment m{};
+			const auto& lo = key_of_(lo_probe);
+			const auto& hi = key_of_(hi_probe);
+			// first node inside [lo, hi): everything in range lies in its subtree
+			index_type split = root_idx_;
+			while(split != null_idx){
+				const Slot& s = slots_[split];
+				if(comp_(s.key(), lo)){ split = s.right; } else if(!comp_(s.key(), hi)){ split = s.left; } else{ break; }
+			}
+			if(split == null_idx) return m.identity();
+			// left of split: keys are below hi, collect from lo upwards, prepending as keys get smaller
+			aggregate_type left = m.identity();
+			for(index_type i = slots_[split].left; i != null_idx;){
+				const Slot& s = slots_[i];
+				if(comp_(s.key(), lo)){
+					i = s.right;
+				} else{
+					left = m.combine(m.combine(m.lift(value_at_(i)), agg_of_(s.right)), left);
+					i = s.left;
+				}
+			}
+			// right of split: keys are at least lo, collect up to hi, appending as keys get larger
+			aggregate_type right = m.identity();
+			for(index_type i = slots_[split].right; i != null_idx;){
+				const Slot& s = slots_[i];
+				if(comp_(s.key(), hi)){
+					right = m.combine(m.combine(right, agg_of_(s.left)), m.lift(value_at_(i)));
+					i = s.right;
+				} else{
+					i = s.left;
+				}
+			}
+			return m.combine(m.combine(left, m.lift(value_at_(split))), right);
+		}
+
+		template<class K, class Keep, class F>
+		constexpr void for_each_pruned_below_(const K& hi, Keep& keep, F& f) const{
+			for_each_pruned_([&](index_type i){ return comp_(slots_[i].key(), key_of_(hi)); }, keep, f);
+		}
+
+		template<class Below, class Keep, class F>
+		constexpr void for_each_pruned_(Below&& below, Keep& keep, F& f) const{
+			const typename Policy::augment m{};
+			auto stack = scratch_<index_type>();
+			auto push_left = [&](index_type i){
+				for(; i != null_idx && keep(std::as_const(slots_[i].agg)); i = slots_[i].left){ stack.push_back(i); }
+				};
+			push_left(root_idx_);
+			while(!stack.empty()){
+				const index_type i = stack.back();
+				stack.pop_back();
+				if(!below(i)) return;
+				const aggregate_type self = m.lift(value_at_(i));
+				if(keep(self)) f(value_at_(i));
+				push_left(slots_[i].right);
+			}
+		}
+
+		template<class K>
+		constexpr size_type rank_(const K& probe) const noexcept{
+			const auto& key = key_of_(probe);
+			size_type r = 0;
+			for(index_type i = root_idx_; i != null_idx;){
+				const Slot& s = slots_[i];
+				if(comp_(s.key(), key)){
+					r += count_of_(s.left) + 1;
+					i = s.right;
+				} else{
+					i = s.left;
+				}
+			}
+			return r;
+		}
+
+		template<class K>
+		constexpr size_type count_(const K& lo, const K& hi) const noexcept{
+			const size_type a = rank_(lo);
+			const size_type b = rank_(hi);
+			return b > a ? b - a : 0;
+		}
+
+		static constexpr size_type batch_lanes = 16; // searches in flight per group, enough to cover DRAM latency
+
+		// group-prefetched descent: calls done(i, raw_idx_or_null_idx) once per key
+		template<class K, class Done>
+		void batch_descend_(std::span<const K> keys, Done&& done) const noexcept{
+			for(size_type base = 0; base < keys.size(); base += batch_lanes){
+				const size_type lanes = std::min(batch_lanes, keys.size() - base);
+				index_type cur[batch_lanes];
+				std::fill_n(cur, lanes, root_idx_);
+				bool active = root_idx_ != null_idx;
+				if(!active){
+					for(size_type j = 0; j < lanes; ++j) done(base + j, null_idx);
+				}
+				while(active){
+					active = false;
+					for(size_type j = 0; j < lanes; ++j){
+						index_type i = cur[j];
+						if(i == null_idx) continue;
+						const Slot& s = slots_[i];
+						const auto& key = key_of_(keys[base + j]);
+						if(comp_(key, s.key())){
+							i = s.left;
+						} else if(comp_(s.key(), key)){
+							i = s.right;
+						} else{
+							done(base + j, i);
+							cur[j] = null_idx;
+							continue;
+						}
+						cur[j] = i;
+						if(i == null_idx){
+							done(base + j, null_idx);
+						} else{
+							detail::prefetch(&slots_[i]);
+							active = true;
+						}
+					}
+				}
+			}
+		}
+
+		template<class K>
+		size_type find_handles_(std::span<const K> keys, std::span<handle_type> out) const noexcept{
+			assert(out.size() >= keys.size());
+			size_type hits = 0;
+			batch_descend_(keys, [&](size_type i, index_type raw){
+				out[i] = to_handle_(raw);
+				hits += (raw != null_idx);
+				});
+			return hits;
+		}
+
+		template<class K>
+		size_type contains_batch_(std::span<const K> keys, std::span<bool> out) const noexcept{
+			assert(out.size() >= keys.size());
+			size_type hits = 0;
+			batch_descend_(keys, [&](size_type i, index_type raw){
+				out[i] = (raw != null_idx);
+				hits += (raw != null_idx);
+				});
+			return hits;
+		}
+
+		template<class K>
+		constexpr bool erase_key_(const K& key){ return erase_key_(key, [](index_type){}); }
+
+		// free every node of order (the in-order index list) for which doomed(rank, raw index) holds and relink
+		// the rest balanced. All decisions come first, so a throwing doomed leaves the tree as it was
+		template<class Doomed>
+		constexpr size_type erase_ranks_(scratch_vector_<index_type> order, Doomed&& doomed){
+			auto victims = scratch_<index_type>();
+			size_type kept = 0;
+			for(size_type r = 0; r < order.size(); ++r){
+				if(doomed(r, order[r])){
+					victims.push_back(order[r]);
+				} else{
+					order[kept++] = order[r];
+				}
+			}
+			if(victims.empty()) return 0;
+			order.erase(order.begin() + static_cast<std::ptrdiff_t>(kept), order.end());
+			for(index_type i : victims){ free_node(i); }
+			root_idx_ = link_balanced_(order); // sets heights, sizes and aggregates on the way up
+			max_count_ = alive_count_;
+			max_hint_ = order.empty() ? null_idx : order.back();
+			if constexpr(has_maintenance){ maint_.too_deep = false; }
+			after_update_(0, null_idx);
+			return victims.size();
+		}
+
+		template<class K>
+		constexpr size_type erase_range_(const K& lo, const K& hi){
+			auto order = inorder_indices_();
+			auto rank_of = [&](const K& probe){
+				const auto& key = key_of_(probe);
+				return static_cast<size_type>(std::partition_point(order.begin(), order.end(),
+					[&](index_type i){ return comp_(slots_[i].key(), key); }) - order.begin());
+				};
+			const size_type first = rank_of(lo);
+			const size_type last = std::max(first, rank_of(hi));
+			if(first == last) return 0;
+			return erase_ranks_(std::move(order), [&](size_type rank, index_type){ return rank >= first && rank < last; });
+		}
+
+		template<class K>
+		constexpr size_type erase_keys_(std::span<const K> keys){
+			if(keys.empty() || root_idx_ == null_idx) return 0;
+			auto sorted = scratch_<const K*>();
+			sorted.reserve(keys.size());
+			for(const K& k : keys){ sorted.push_back(&k); }
+			auto less = [&](const K* a, const K* b){ return comp_(key_of_(*a), key_of_(*b)); };
+			if(!std::is_sorted(sorted.begin(), sorted.end(), less)) std::sort(sorted.begin(), sorted.end(), less);
+			size_type next = 0; // both sides ascend, so the keys are walked once alongside the tree
+			return erase_ranks_(inorder_indices_(), [&](size_type, index_type i){
+				const key_type& k = slots_[i].key();
+				while(next < sorted.size() && comp_(key_of_(*sorted[next]), k)){ ++next; }
+				return next < sorted.size() && !comp_(k, key_of_(*sorted[next]));
+				});
+		}
+
+		// before_unlink(raw index) runs once the node is found, while it is still linked (extract() moves the value out)
+		template<class K, class F>
+		constexpr bool erase_key_(const K& key, F&& before_unlink){
+			if constexpr(is_avl){
+				search_path path;
+				const index_type hit = descend_path_(key, path);
+				if(hit == null_idx) return false;
+				before_unlink(hit);
+				erase_path_(path);
+				after_update_(0, null_idx);
+				return true;
+			} else{
+				if constexpr(is_augmented){
+					search_path path;
+					const index_type hit = descend_path_(key, path);
+					if(hit == null_idx) return false;
+					before_unlink(hit);
+					erase_path_(path);
+				} else{
+					const auto r = find_path_(key);
+					if(r.cur == null_idx) return false;
+					before_unlink(r.cur);
+					erase_internal(r.parent, r.cur);
+				}
+				if constexpr(is_scapegoat){
+					// too many erases since the last full rebuild: the height bound no longer holds
+					if(alive_count_ * Policy::balance::den < max_count_ * Policy::balance::num) rebalance_in_place();
+				}
+				after_update_(0, null_idx);
+				return true;
+			}
+		}
+
 		struct path_result final{
 			index_type parent = null_idx; // parent of cur if found, or insertion parent if not found
 			index_type cur = null_idx; // found node, or npos_raw if not found
 			bool go_left = false;    // only meaningful when cur == npos_raw and parent != npos_raw
+			size_type depth = 0;     // nodes visited, only counted for maintenance_policy
 		};
 
-		constexpr path_result find_path_(const value_type& key) const{
+		template<class K>
+		constexpr path_result find_path_(const K& probe) const{
+			const auto& key = key_of_(probe);
 			index_type parent = null_idx;
 			index_type cur = root_idx_;
 			bool go_left = false;
+			[[maybe_unused]] size_type depth = 0;
+			note_search_();
 
 			while(cur != null_idx){
 				const Slot& s = slots_[cur];
-				if(comp_(key, s.value())){
+				if constexpr(has_maintenance){ ++depth; }
+				if(comp_(key, s.key())){
+					note_visit_(1);
 					parent = cur;
 					go_left = true;
 					cur = s.left;
-				} else if(comp_(s.value(), key)){
+				} else if(comp_(s.key(), key)){
+					note_visit_(2);
 					parent = cur;
 					go_left = false;
 					cur = s.right;
 				} else{
 					// Found exact match
+					note_visit_(2);
 					return {parent, cur, false};
 				}
 			}
 
 			// Not found: parent is insertion point (or npos_raw if tree empty)
-			return {parent, null_idx, go_left};
+			return {parent, null_idx, go_left, depth};
 		}
 
 		template<class V>
 		constexpr std::pair<handle_type, bool> insert_impl(V&& v){
 			// Important: don't move from v during comparisons
 			const value_type& key = v;
+			return insert_with_(key, [&]{ return allocate_node(std::forward<V>(v)); });
+		}
 
-			const path_result r = find_path_(key);
-			if(r.cur != null_idx){
-				return {make_handle(r.cur), false};
+		template<class K, class Make>
+		constexpr std::pair<handle_type, bool> insert_hinted_(handle_type hint, const K& key, Make&& make){
+			if constexpr(!is_avl && !is_scapegoat && !has_maintenance){ // maintenance needs the depth a descent gives
+				if(is_handle_valid(hint)){
+					const index_type at = Layout::unpack_index(hint);
+					if(at == max_index_() && comp_(slots_[at].key(), key_of_(key))){
+						const index_type idx = make();
+						slots_[at].right = idx;
+						max_hint_ = idx;
+						return {make_handle(idx), true};
+					}
+				}
 			}
+			return insert_with_(key, make);
+		}
 
-			const index_type idx = allocate_node(std::forward<V>(v));
+		// the largest element, walking the right spine only when the cached answer was dropped
+		constexpr index_type max_index_() noexcept{
+			if(max_hint_ == null_idx){
+				for(index_type i = root_idx_; i != null_idx; i = slots_[i].right){ max_hint_ = i; }
+			}
+			return max_hint_;
+		}
 
-			if(r.parent == null_idx){
-				root_idx_ = idx; // empty tree case
-			} else if(r.go_left){
-				slots_[r.parent].left = idx;
+		// insert at key's position unless an equivalent element exists. make() allocates the new node,
+		// it runs only once the spot is known to be free, so nothing is constructed for a duplicate.
+		template<class K, class Make>
+		constexpr std::pair<handle_type, bool> insert_with_(const K& key, Make&& make){
+			if constexpr(is_avl || is_scapegoat){
+				std::pair<handle_type, bool> r;
+				if constexpr(is_avl){ r = insert_avl_(key, make); } else{ r = insert_scapegoat_(key, make); }
+				if(r.second) after_update_(0, Layout::unpack_index(r.first));
+				return r;
 			} else{
-				slots_[r.parent].right = idx;
-			}
+				const path_result r = find_path_(key);
+				if(r.cur != null_idx){
+					return {make_handle(r.cur), false};
+				}
 
-			return {make_handle(idx), true};
+				const index_type idx = make();
+
+				if(r.parent == null_idx){
+					root_idx_ = idx; // empty tree case
+				} else if(r.go_left){
+					slots_[r.parent].left = idx;
+				} else{
+					slots_[r.parent].right = idx;
+					if(r.parent == max_hint_) max_hint_ = idx;
+				}
+				after_update_(r.depth + 1, idx);
+				return {make_handle(idx), true};
+			}
 		}
 
 		constexpr void relink_child(index_type parent, index_type old_child, index_type new_child){
@@ -631,7 +2388,9 @@ namespace flat {
 			// find successor y = min(Z.right)
 			index_type parent_y = z;
 			index_type y = Z.right;
+			note_visit_(0);
 			while(slots_[y].left != null_idx){
+				note_visit_(0); // links only, no comparisons
 				parent_y = y;
 				y = slots_[y].left;
 			}
@@ -648,35 +2407,634 @@ namespace flat {
 
 
 		
+		// a not-yet-built subtree: sorted input offsets [lo, hi) and where to hang its root
+		struct pending_range final{
+			size_type lo = 0;
+			size_type hi = 0;
+			index_type parent = null_idx;
+			bool go_left = false;
+		};
+
+		// Height bound of the self-balancing policies for n < 2^idx_bits nodes:
+		// AVL is at most ~1.44 * idx_bits tall, scapegoat at most log_{1/alpha}(n) + 1.
+		static constexpr size_type max_path_depth = []{
+			if constexpr(is_scapegoat){
+				size_type h = 0;
+				for(double reach = 1.0; reach < static_cast<double>(Layout::idx_mask); ++h){
+					reach = reach * Policy::balance::den / Policy::balance::num;
+				}
+				return h + 2;
+			} else{
+				return static_cast<size_type>(Layout::idx_bits) * 3 / 2 + 2;
+			}
+		}();
+
+		// root-to-node chain of raw indices, the last entry being the node itself (or its would-be parent)
+		struct search_path final{
+			index_type nodes[max_path_depth];
+			size_type depth = 0;
+			bool go_left = false; // direction taken from the last entry, when the search missed
+			constexpr void push(index_type i) noexcept{
+				assert(depth < max_path_depth);
+				nodes[depth++] = i;
+			}
+		};
+
+		// hang a freshly allocated leaf below the last entry of a missed search
+		constexpr void attach_leaf_(const search_path& path, index_type idx) noexcept{
+			if(path.depth == 0){
+				root_idx_ = idx;
+			} else if(path.go_left){
+				slots_[path.nodes[path.depth - 1]].left = idx;
+			} else{
+				const index_type parent = path.nodes[path.depth - 1];
+				slots_[parent].right = idx;
+				if(parent == max_hint_) max_hint_ = idx;
+			}
+		}
+
+		// collect the raw indices of the subtree at i in sorted order
+		constexpr void collect_inorder_(index_type i, scratch_vector_<index_type>& out) const{
+			auto stack = scratch_<index_type>();
+			stack.reserve(traversal_stack_reserve);
+			while(i != null_idx || !stack.empty()){
+				while(i != null_idx){
+					stack.push_back(i);
+					i = slots_[i].left;
+				}
+				i = stack.back();
+				stack.pop_back();
+				out.push_back(i);
+				i = slots_[i].right;
+			}
+		}
+
+		// hang a sorted run of fresh nodes in the gap just before `gap`. of two inorder neighbours,
+		// either the predecessor has no right child or the successor has no left child
+		constexpr void attach_run_(const_inorder_iterator gap, const scratch_vector_<index_type>& run){
+			if(run.empty()) return;
+			const index_type next = gap.cur_raw_;
+			const index_type sub = link_balanced_(run);
+			if(root_idx_ == null_idx){ root_idx_ = sub; return; }
+			--gap;
+			const index_type prev = gap.cur_raw_;
+			if(prev != null_idx && slots_[prev].right == null_idx){
+				slots_[prev].right = sub;
+				if(prev == max_hint_) max_hint_ = null_idx;
+			} else{
+				assert(next != null_idx && slots_[next].left == null_idx);
+				slots_[next].left = sub;
+			}
+		}
+
+		static constexpr unsigned keep_mine_ = 1, keep_theirs_ = 2, keep_both_ = 4;
+
+		constexpr scratch_vector_<index_type> inorder_indices_() const{
+			auto out = scratch_<index_type>();
+			out.reserve(alive_count_);
+			collect_inorder_(root_idx_, out);
+			return out;
+		}
+
+		// pair up two in-order index lists: f(a, b) once per key of either tree, null_idx on the side without it
+		template<class F>
+		constexpr void merge_walk_(const bst& other, const scratch_vector_<index_type>& mine, const scratch_vector_<index_type>& theirs, F&& f) const{
+			size_type i = 0, j = 0;
+			while(i < mine.size() && j < theirs.size()){
+				const key_type& a = slots_[mine[i]].key();
+				const key_type& b = other.slots_[theirs[j]].key();
+				if(comp_(a, b)){
+					f(mine[i++], null_idx);
+				} else if(comp_(b, a)){
+					f(null_idx, theirs[j++]);
+				} else{
+					f(mine[i++], theirs[j++]);
+				}
+			}
+			for(; i < mine.size(); ++i){ f(mine[i], null_idx); }
+			for(; j < theirs.size(); ++j){ f(null_idx, theirs[j]); }
+		}
+
+		template<unsigned Keep>
+		constexpr bst combine_(const bst& other, size_type bound, layout order) const{
+			const auto mine = inorder_indices_();
+			const auto theirs = other.inorder_indices_();
+			auto picked = scratch_<const value_type*>();
+			picked.reserve(bound);
+			merge_walk_(other, mine, theirs, [&](index_type a, index_type b){
+				const bool in_mine = a != null_idx, in_theirs = b != null_idx;
+				if(Keep & (in_mine ? (in_theirs ? keep_both_ : keep_mine_) : keep_theirs_)){
+					picked.push_back(in_mine ? &value_at_(a) : &other.value_at_(b));
+				}
+				});
+			bst out(comp_, get_allocator());
+			out.build_balanced_into_empty_(picked.size(), [&](size_type rank) -> const value_type&{ return *picked[rank]; }, order);
+			return out;
+		}
+
+		template<class K>
+		constexpr bst split_(const K& probe, layout order){
+			const auto& key = key_of_(probe);
+			// the nodes where the search turns left, each followed by its right subtree, are
+			// the elements >= key in order, deepest turn first
+			auto turns = scratch_<index_type>();
+			for(index_type cur = root_idx_; cur != null_idx;){
+				if(comp_(slots_[cur].key(), key)){
+					cur = slots_[cur].right;
+				} else{
+					turns.push_back(cur);
+					cur = slots_[cur].left;
+				}
+			}
+			auto moved = scratch_<index_type>();
+			moved.reserve(alive_count_);
+			for(size_type d = turns.size(); d-- > 0;){
+				moved.push_back(turns[d]);
+				collect_inorder_(slots_[turns[d]].right, moved);
+			}
+			bst upper(comp_, get_allocator());
+			upper.build_balanced_into_empty_(moved.size(), [&](size_type rank) -> decltype(auto){
+				return std::move_if_noexcept(value_at_(moved[rank]));
+				}, order);
+			// nothing below throws before the rebalance: chain the right turns into the kept tree
+			index_type* hook = &root_idx_;
+			for(index_type cur = root_idx_; cur != null_idx;){
+				if(comp_(slots_[cur].key(), key)){
+					*hook = cur;
+					hook = &slots_[cur].right;
+					cur = slots_[cur].right;
+				} else{
+					cur = slots_[cur].left;
+				}
+			}
+			*hook = null_idx;
+			for(index_type i : moved){ free_node(i); }
+			if constexpr(is_avl || is_scapegoat){ rebalance_in_place(); }
+			return upper;
+		}
+
+		// relink the subtree at i into midpoint shape, returns its new root
+		constexpr index_type relink_balanced_(index_type i){
+			auto order = scratch_<index_type>();
+			if constexpr(is_scapegoat){ order.reserve(subtree_size_(i)); } else{ order.reserve(alive_count_); }
+			collect_inorder_(i, order);
+			return link_balanced_(order);
+		}
+
+		// link nodes given in sorted order into midpoint shape, returns the subtree root
+		constexpr index_type link_balanced_(const scratch_vector_<index_type>& order){
+			auto link = [&](auto&& self, size_type lo, size_type hi) -> index_type{
+				if(lo == hi) return null_idx;
+				const size_type mid = lo + (hi - lo) / 2;
+				const index_type me = order[mid];
+				slots_[me].left = self(self, lo, mid);
+				slots_[me].right = self(self, mid + 1, hi);
+				if constexpr(is_avl){
+					slots_[me].set_height(static_cast<index_type>(std::bit_width(hi - lo)));
+				}
+				if constexpr(has_sizes){ slots_[me].count = static_cast<index_type>(hi - lo); }
+				if constexpr(has_aggregate){ update_aggregate_(me); } // children are linked by now
+				return me;
+				};
+			return link(link, 0, order.size());
+		}
+
+		// recursion is fine here: only used on scapegoat trees, whose height is logarithmic
+		constexpr size_type subtree_size_(index_type i) const noexcept{
+			if(i == null_idx) return 0;
+			if constexpr(has_sizes){ return slots_[i].count; }
+			return 1 + subtree_size_(slots_[i].left) + subtree_size_(slots_[i].right);
+		}
+
+		// scapegoat trigger: depth beyond log_{1/alpha}(n)
+		static constexpr bool too_deep_(size_type depth, size_type n) noexcept{
+			double reach = 1.0; // (1/alpha)^depth, stop as soon as it passes n
+			for(size_type i = 0; i < depth && reach <= static_cast<double>(n); ++i){
+				reach = reach * Policy::balance::den / Policy::balance::num;
+			}
+			return reach > static_cast<double>(n);
+		}
+
+		template<class K, class Make>
+		constexpr std::pair<handle_type, bool> insert_scapegoat_(const K& key, Make& make){
+			search_path path;
+			if(const index_type hit = descend_path_(key, path); hit != null_idx){
+				return {make_handle(hit), false};
+			}
+			const index_type idx = make();
+			update_node_(idx);
+			attach_leaf_(path, idx);
+			max_count_ = std::max(max_count_, alive_count_);
+
+			if(too_deep_(path.depth, alive_count_)){
+				// climb until a child holds more than alpha of its parent's subtree, rebuild there
+				index_type child = idx;
+				size_type child_size = 1;
+				for(size_type i = path.depth; i-- > 0;){
+					const index_type x = path.nodes[i];
+					const index_type sibling = (slots_[x].left == child) ? slots_[x].right : slots_[x].left;
+					const size_type size = 1 + child_size + subtree_size_(sibling);
+					if(child_size * Policy::balance::den > size * Policy::balance::num){
+						index_type top;
+						try{
+							top = relink_balanced_(x); // throws only on its scratch buffer, before relinking anything
+						} catch(...){
+							repair_path_(path, path.depth); // the new leaf stays, too deep but counted
+							throw;
+						}
+						relink_child(i > 0 ? path.nodes[i - 1] : null_idx, x, top);
+						break;
+					}
+					child = x;
+					child_size = size;
+				}
+			}
+			repair_path_(path, path.depth); // sizes and aggregates only; nodes inside a rebuilt subtree are already right
+			return {make_handle(idx), true};
+		}
+
+		constexpr index_type height_of_(index_type i) const noexcept{
+			return i == null_idx ? 0 : slots_[i].height();
+		}
+
+		constexpr index_type index_of_(const Slot& s) const noexcept{ return static_cast<index_type>(&s - slots_.data()); }
+
+		// recompute what i keeps about its subtree (AVL height, size) from its children
+		constexpr void update_node_(index_type i) noexcept{
+			Slot& s = slots_[i];
+			if constexpr(is_avl){
+				s.set_height(static_cast<index_type>(1 + std::max(height_of_(s.left), height_of_(s.right))));
+			}
+			if constexpr(has_sizes){
+				s.count = static_cast<index_type>(1 + count_of_(s.left) + count_of_(s.right));
+			}
+			if constexpr(has_aggregate){ update_aggregate_(i); }
+		}
+
+		constexpr void update_aggregate_(index_type i) noexcept{
+			const typename Policy::augment m{};
+			Slot& s = slots_[i];
+			s.agg = m.combine(m.combine(agg_of_(s.left), m.lift(value_at_(i))), agg_of_(s.right));
+		}
+
+		constexpr aggregate_type agg_of_(index_type i) const noexcept{
+			if(i == null_idx) return typename Policy::augment{}.identity();
+			return slots_[i].agg;
+		}
+
+		constexpr size_type count_of_(index_type i) const noexcept{
+			if constexpr(has_sizes){ return i == null_idx ? 0 : slots_[i].count; } else{ return 0; }
+		}
+
+		// bottom-up repair of path[0, depth) after a leaf was added or removed below it
+		constexpr void repair_path_(const search_path& path, size_type depth) noexcept{
+			if constexpr(is_avl){
+				retrace_(path, depth);
+			} else if constexpr(is_augmented){
+				while(depth > 0){ update_node_(path.nodes[--depth]); }
+			}
+		}
+
+		constexpr index_type rotate_right_(index_type x) noexcept{
+			const index_type y = slots_[x].left;
+			slots_[x].left = slots_[y].right;
+			slots_[y].right = x;
+			update_node_(x);
+			update_node_(y);
+			return y;
+		}
+
+		constexpr index_type rotate_left_(index_type x) noexcept{
+			const index_type y = slots_[x].right;
+			slots_[x].right = slots_[y].left;
+			slots_[y].left = x;
+			update_node_(x);
+			update_node_(y);
+			return y;
+		}
+
+		// restore the AVL invariant at x, returns the new root of x's subtree
+		constexpr index_type rebalance_(index_type x) noexcept{
+			const Slot& s = slots_[x];
+			const int balance = int(height_of_(s.left)) - int(height_of_(s.right));
+			if(balance > 1){
+				const Slot& l = slots_[s.left];
+				if(height_of_(l.left) < height_of_(l.right)) slots_[x].left = rotate_left_(s.left);
+				return rotate_right_(x);
+			}
+			if(balance < -1){
+				const Slot& r = slots_[s.right];
+				if(height_of_(r.right) < height_of_(r.left)) slots_[x].right = rotate_right_(s.right);
+				return rotate_left_(x);
+			}
+			update_node_(x);
+			return x;
+		}
+
+		// walk path[0, depth) bottom-up fixing heights and rotating; stops once a subtree height is unchanged,
+		// unless sizes or aggregates have to be repaired all the way up
+		constexpr void retrace_(const search_path& path, size_type depth) noexcept{
+			while(depth > 0){
+				const index_type x = path.nodes[--depth];
+				const index_type old_height = slots_[x].height();
+				const index_type top = rebalance_(x);
+				if(top != x) relink_child(depth > 0 ? path.nodes[depth - 1] : null_idx, x, top);
+				if(!is_augmented && slots_[top].height() == old_height) return;
+			}
+		}
+
+		// descend towards key recording the path. Returns the matching node (last in path) or null_idx,
+		// in which case the last path entry is the insertion parent.
+		template<class K>
+		constexpr index_type descend_path_(const K& probe, search_path& path) const noexcept{
+			const auto& key = key_of_(probe);
+			index_type cur = root_idx_;
+			note_search_();
+			while(cur != null_idx){
+				path.push(cur);
+				const Slot& s = slots_[cur];
+				if(comp_(key, s.key())){
+					note_visit_(1);
+					path.go_left = true;
+					cur = s.left;
+				} else if(comp_(s.key(), key)){
+					note_visit_(2);
+					path.go_left = false;
+					cur = s.right;
+				} else{
+					note_visit_(2);
+					return cur;
+				}
+			}
+			return null_idx;
+		}
+
+		template<class K, class Make>
+		constexpr std::pair<handle_type, bool> insert_avl_(const K& key, Make& make){
+			search_path path;
+			if(const index_type hit = descend_path_(key, path); hit != null_idx){
+				return {make_handle(hit), false};
+			}
+			const index_type idx = make();
+			update_node_(idx); // a leaf: height 1, size 1
+			attach_leaf_(path, idx);
+			retrace_(path, path.depth);
+			return {make_handle(idx), true};
+		}
+
+		// path ends at the node to erase. Same successor splice as erase_internal, then a bottom-up repair.
+		constexpr void erase_path_(search_path& path) noexcept{
+			const size_type zd = path.depth - 1;
+			const index_type z = path.nodes[zd];
+			const index_type parent_z = zd > 0 ? path.nodes[zd - 1] : null_idx;
+			Slot& Z = slots_[z];
+			if(Z.left == null_idx || Z.right == null_idx){
+				relink_child(parent_z, z, Z.left == null_idx ? Z.right : Z.left);
+				free_node(z);
+				repair_path_(path, zd);
+				return;
+			}
+			// successor y = min(Z.right); y takes z's place on the path
+			index_type y = Z.right;
+			path.push(y);
+			note_visit_(0);
+			while(slots_[y].left != null_idx){
+				y = slots_[y].left;
+				path.push(y);
+				note_visit_(0);
+			}
+			const index_type parent_y = path.nodes[path.depth - 2];
+			if(parent_y != z){
+				relink_child(parent_y, y, slots_[y].right);
+				slots_[y].right = Z.right;
+			}
+			slots_[y].left = Z.left;
+			slots_[y].set_height(Z.height()); // so retrace_ sees the height z's position had
+			relink_child(parent_z, z, y);
+			free_node(z);
+			path.nodes[zd] = y;
+			repair_path_(path, path.depth - 1); // drop y itself, it now lives at path[zd]
+		}
+
 		template<class It>
 			requires std::random_access_iterator<It>
-		void build_from_sorted_unique_into_empty(It first, It last){
-			const size_type n = static_cast<size_type>(std::distance(first, last));
+		constexpr void build_from_sorted_unique_into_empty(It first, It last, layout order = layout::preorder){
+			build_balanced_into_empty_(static_cast<size_type>(std::distance(first, last)),
+				[&](size_type rank) -> decltype(auto){ return first[static_cast<std::ptrdiff_t>(rank)]; }, order);
+		}
+
+		// at(rank) yields the rank-th smallest value, it is called exactly once per rank
+		template<class At>
+		constexpr void build_balanced_into_empty_(size_type n, At&& at, layout order){
 			if(n == 0){ root_idx_ = null_idx; return; }
-			slots_.reserve(n);
+			reserve(n);
+			const auto plan = build_plan_(n, order);
+			build_planned_(n, at, order, plan);
+		}
 
-			auto build = [&](auto&& self, It lo, It hi) -> index_type{
-				if(lo == hi) return null_idx;
-				It mid = lo + (std::distance(lo, hi) / 2);
-				// allocate_node will just append since we started empty
-				index_type me = allocate_node(*mid);
-				Slot& m = slots_[me];
-				m.left = self(self, lo, mid);
-				m.right = self(self, std::next(mid), hi);
+		// every allocation a balanced build of n values needs, taken before the first value is moved in:
+		// the order in which eytzinger and veb emit their nodes (preorder recurses and needs none).
+		// Pair with reserve(n) and build_planned_(), which then cannot fail but on at() or a key copy
+		constexpr scratch_vector_<pending_range> build_plan_(size_type n, layout order) const{
+			auto plan = scratch_<pending_range>();
+			if(n == 0 || order == layout::preorder) return plan;
+			plan.reserve(n);
+			size_type emitted = 0; // slots are appended in emission order, so this is the slot a node gets
+			auto children = [&](const pending_range& r, scratch_vector_<pending_range>& into){
+				const size_type mid = r.lo + (r.hi - r.lo) / 2;
+				const auto me = static_cast<index_type>(emitted++);
+				plan.push_back(r);
+				if(r.lo < mid) into.push_back({r.lo, mid, me, true});
+				if(mid + 1 < r.hi) into.push_back({mid + 1, r.hi, me, false});
+				};
+			if(order == layout::eytzinger){
+				auto queue = scratch_<pending_range>();
+				queue.reserve(n);
+				queue.push_back({0, n, null_idx, false});
+				for(size_type head = 0; head < queue.size(); ++head){ children(pending_range(queue[head]), queue); }
+			} else{
+				// lay out the top half of the levels first, then each subtree hanging below it.
+				// subtrees too deep for 'levels' are handed back through 'frontier'.
+				auto build = [&](auto&& self, const pending_range& r, int levels, scratch_vector_<pending_range>& frontier) -> void{
+					if(levels == 1){
+						children(r, frontier);
+						return;
+					}
+					const int top = levels / 2;
+					auto below = scratch_<pending_range>();
+					self(self, r, top, below);
+					for(const pending_range& sub : below){
+						self(self, sub, levels - top, frontier);
+					}
+					};
+				auto rest = scratch_<pending_range>();
+				build(build, pending_range{0, n, null_idx, false}, static_cast<int>(std::bit_width(n)), rest);
+				assert(rest.empty());
+			}
+			return plan;
+		}
+
+		// emit the n nodes into this empty, reserve(n)ed tree, in the order build_plan_(n, order) gave
+		template<class At>
+		constexpr void build_planned_(size_type n, At&& at, layout order, const scratch_vector_<pending_range>& plan){
+			if(n == 0){ root_idx_ = null_idx; return; }
+			max_count_ = n;
+
+			// allocate_node will just append since we started empty
+			auto emit = [&](const pending_range& r) -> index_type{
+				const size_type mid = r.lo + (r.hi - r.lo) / 2;
+				const index_type me = allocate_node(at(mid));
+				if constexpr(is_avl){
+					slots_[me].set_height(static_cast<index_type>(std::bit_width(r.hi - r.lo))); // midpoint subtrees are as short as possible
+				}
+				if constexpr(has_sizes){ slots_[me].count = static_cast<index_type>(r.hi - r.lo); }
+				if(r.parent == null_idx){
+					root_idx_ = me;
+				} else if(r.go_left){
+					slots_[r.parent].left = me;
+				} else{
+					slots_[r.parent].right = me;
+				}
 				return me;
 				};
-			root_idx_ = build(build, first, last);
+
+			if(order == layout::preorder){
+				auto build = [&](auto&& self, const pending_range& r) -> void{
+					if(r.lo == r.hi) return;
+					const size_type mid = r.lo + (r.hi - r.lo) / 2;
+					const index_type me = emit(r);
+					self(self, pending_range{r.lo, mid, me, true});
+					self(self, pending_range{mid + 1, r.hi, me, false});
+					};
+				build(build, pending_range{0, n, null_idx, false});
+			} else{
+				assert(plan.size() == n);
+				for(const pending_range& r : plan){ emit(r); }
+			}
+			update_built_aggregates_(n);
+		}
+
+		// turn the unlinked, gap-free slots listed in key order by sorted into the tree build_balanced_into_empty_
+		// would lay out: swap each value into its layout slot, then link. Allocates only index buffers
+		constexpr void place_inorder_(const scratch_vector_<index_type>& sorted, layout order){
+			const size_type n = sorted.size();
+			assert(n == slots_.size() && n == alive_count_);
+			auto target = scratch_<index_type>(); // target[rank]: the slot that rank is laid out in
+			auto to = scratch_<index_type>(); // to[slot]: where the value now in slot belongs
+			target.reserve(n);
+			to.reserve(n);
+			for(size_type i = 0; i < n; ++i){ target.push_back(null_idx); to.push_back(null_idx); }
+			if(order == layout::preorder){
+				size_type emitted = 0;
+				auto place = [&](auto&& self, size_type lo, size_type hi) -> void{
+					if(lo == hi) return;
+					const size_type mid = lo + (hi - lo) / 2;
+					target[mid] = static_cast<index_type>(emitted++);
+					self(self, lo, mid);
+					self(self, mid + 1, hi);
+					};
+				place(place, 0, n);
+			} else{
+				const auto plan = build_plan_(n, order);
+				for(size_type k = 0; k < n; ++k){ target[plan[k].lo + (plan[k].hi - plan[k].lo) / 2] = static_cast<index_type>(k); }
+			}
+			for(size_type r = 0; r < n; ++r){ to[sorted[r]] = target[r]; }
+			for(size_type i = 0; i < n; ++i){
+				while(to[i] != i){
+					const index_type j = to[i];
+					using std::swap;
+					swap(slots_[i], slots_[j]);
+					if constexpr(is_soa){ swap(payloads_[i], payloads_[j]); }
+					swap(to[i], to[j]);
+				}
+			}
+			root_idx_ = link_balanced_(target); // sets heights, sizes and aggregates on the way up
+			max_count_ = n;
+		}
+
+		// after a build into an empty tree. every layout places parents first, so walking back from the
+		// last slot meets children first
+		constexpr void update_built_aggregates_([[maybe_unused]] size_type n) noexcept{
+			if constexpr(has_aggregate){
+				for(size_type i = n; i-- > 0;){ update_aggregate_(static_cast<index_type>(i)); }
+			}
 		}
 
+#if defined(FLAT_BST_PARALLEL)
+		// same tree as the serial build. In preorder the subtree over ranks [lo, hi) fills the slots
+		// [base, base + hi - lo), its root first, so each slot finds its node with one descent over ranks
+		// and all slots can be constructed concurrently.
+		template<class ExecutionPolicy, class At>
+		void build_balanced_into_empty_(ExecutionPolicy&& exec, size_type n, At&& at, layout order){
+			if(order != layout::preorder){ build_balanced_into_empty_(n, at, order); return; }
+			if(n == 0){ root_idx_ = null_idx; return; }
+			if(n >= static_cast<size_type>(null_idx)) throw std::length_error("BST index overflow");
+			slots_.resize(n); // dead slots, revived in place below
+			if constexpr(is_soa){ payloads_.resize(n); }
+			std::for_each(exec, slots_.begin(), slots_.end(), [&](Slot& s){
+				const auto pos = static_cast<size_type>(&s - slots_.data());
+				size_type lo = 0, hi = n, base = 0, mid = n / 2;
+				while(pos != base){
+					if(pos <= base + (mid - lo)){
+						hi = mid;
+						base += 1;
+					} else{
+						base += 1 + (mid - lo);
+						lo = mid + 1;
+					}
+					mid = lo + (hi - lo) / 2;
+				}
+				if constexpr(is_soa){
+					payloads_[pos].emplace(at(mid));
+					s.revive(key_of_(*payloads_[pos]));
+				} else{
+					s.revive(at(mid));
+				}
+				s.left = lo < mid ? static_cast<index_type>(base + 1) : null_idx;
+				s.right = mid + 1 < hi ? static_cast<index_type>(base + 1 + (mid - lo)) : null_idx;
+				if constexpr(is_avl){ s.set_height(static_cast<index_type>(std::bit_width(hi - lo))); }
+				if constexpr(has_sizes){ s.count = static_cast<index_type>(hi - lo); }
+				});
+			root_idx_ = 0;
+			alive_count_ = n;
+			max_count_ = n;
+			update_built_aggregates_(n);
+		}
+#endif
+
 		constexpr bool equiv_(const value_type& a, const value_type& b) const
-			noexcept(noexcept(comp_(a, b)) && noexcept(comp_(b, a))){
-			return !comp_(a, b) && !comp_(b, a);
+			noexcept(noexcept(comp_(key_of_(a), key_of_(b)))){
+			return !comp_(key_of_(a), key_of_(b)) && !comp_(key_of_(b), key_of_(a));
 		}
 	};
 
-	template<class T, class Compare, class IndexT>
-	void swap(bst<T, Compare, IndexT>& a, bst<T, Compare, IndexT>& b)
+	template<class T, class Compare, class IndexT, class Policy>
+	void swap(bst<T, Compare, IndexT, Policy>& a, bst<T, Compare, IndexT, Policy>& b)
 		noexcept(noexcept(a.swap(b))){
 		a.swap(b);
 	}
+}
+
+namespace flat {
+	// Fixed-capacity tree for hot paths: up to N slots inline, IndexT sized from N, nothing on the heap.
+	template<class T, std::size_t N, class Compare = std::less<T>, class Policy = default_policy>
+	using static_bst = bst<T, Compare, detail::index_for_capacity<N>, inline_policy<N, Policy>>;
+
+	// A static_bst built from an array, for lookup tables made entirely at compile time:
+	//   constexpr auto keywords = flat::make_static_bst(std::array<std::string_view, 3>{"if", "else", "for"});
+	// The values may come in any order, duplicates are dropped. A constexpr table is constant-initialized
+	// into read-only data: no startup cost, no allocation. Eytzinger order by default, so the top levels
+	// of every search share cache lines.
+	template<class T, std::size_t N, class Compare = std::less<T>>
+	[[nodiscard]] constexpr static_bst<T, N, Compare> make_static_bst(const std::array<T, N>& values, Compare cmp = Compare{},
+		layout order = layout::eytzinger){
+		static_bst<T, N, Compare> out(std::move(cmp));
+		out.build_from_range(values.begin(), values.end(), order);
+		return out;
+	}
+}
+
+namespace flat::pmr {
+	template<class T, class Compare = std::less<T>, class IndexT = uint32_t, class Policy = default_policy>
+	using bst = flat::bst<T, Compare, IndexT, pmr_policy<Policy>>;
 }
\ No newline at end of file
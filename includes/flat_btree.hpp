@@ -0,0 +1,621 @@
+// flat::btree<T, Compare, IndexT, NodeWidth> - a flat, wide-node companion to flat::bst
+// Packs up to NodeWidth sorted keys per node so one (SIMD) compare picks the child,
+// cutting tree height by log2(NodeWidth) compared to the binary tree.
+// Keys move between nodes on split/merge, so handles go through a small generational
+// slot table (same index_layout packing as flat::bst) and stay valid until erased.
+// Requires C++20. See test.cpp for usage examples.
+
+#pragma once
+#include "flat_bst.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace flat::detail {
+	// std::less / std::greater over an arithmetic T can be answered by counting raw numeric compares
+	template<class T, class Compare>
+	inline constexpr int numeric_order = 0; // 0 = unknown, use Compare
+	template<class T>
+	inline constexpr int numeric_order<T, std::less<T>> = std::is_arithmetic_v<T> ? 1 : 0;
+	template<class T>
+	inline constexpr int numeric_order<T, std::less<>> = std::is_arithmetic_v<T> ? 1 : 0;
+	template<class T>
+	inline constexpr int numeric_order<T, std::greater<T>> = std::is_arithmetic_v<T> ? -1 : 0;
+	template<class T>
+	inline constexpr int numeric_order<T, std::greater<>> = std::is_arithmetic_v<T> ? -1 : 0;
+
+	// number of keys[0, count) that are numerically below (Greater == false) or above (Greater == true) key
+	template<bool Greater, std::size_t W, class T>
+	inline std::size_t count_beyond(const std::array<T, W>& keys, std::size_t count, T key) noexcept{
+#if defined(__AVX2__)
+		if constexpr(W % 8 == 0 && sizeof(T) == 4 && (std::is_integral_v<T> || std::is_same_v<T, float>)){
+			const std::uint64_t valid = (count >= 64) ? ~std::uint64_t(0) : ((std::uint64_t(1) << count) - 1);
+			std::uint64_t hits = 0;
+			for(std::size_t b = 0; b < W; b += 8){
+				unsigned mask;
+				if constexpr(std::is_same_v<T, float>){
+					const __m256 k = _mm256_set1_ps(key);
+					const __m256 v = _mm256_loadu_ps(keys.data() + b);
+					mask = static_cast<unsigned>(_mm256_movemask_ps(Greater ? _mm256_cmp_ps(v, k, _CMP_GT_OQ) : _mm256_cmp_ps(v, k, _CMP_LT_OQ)));
+				} else{
+					// AVX2 only has signed compares: flip the sign bit to order unsigned keys
+					const int flip = std::is_signed_v<T> ? 0 : static_cast<int>(0x80000000u);
+					const __m256i f = _mm256_set1_epi32(flip);
+					const __m256i k = _mm256_xor_si256(_mm256_set1_epi32(static_cast<int>(key)), f);
+					const __m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys.data() + b)), f);
+					const __m256i gt = Greater ? _mm256_cmpgt_epi32(v, k) : _mm256_cmpgt_epi32(k, v);
+					mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(gt)));
+				}
+				hits |= std::uint64_t(mask) << b;
+			}
+			return static_cast<std::size_t>(std::popcount(hits & valid));
+		}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+		if constexpr(W % 4 == 0 && sizeof(T) == 4 && (std::is_integral_v<T> || std::is_same_v<T, float>)){
+			const std::uint32_t lane_idx[4] = {0, 1, 2, 3};
+			const uint32x4_t n = vdupq_n_u32(static_cast<std::uint32_t>(count));
+			uint32x4_t idx = vld1q_u32(lane_idx);
+			uint32x4_t total = vdupq_n_u32(0);
+			for(std::size_t b = 0; b < W; b += 4){
+				uint32x4_t hit;
+				if constexpr(std::is_same_v<T, float>){
+					const float32x4_t v = vld1q_f32(keys.data() + b);
+					hit = Greater ? vcgtq_f32(v, vdupq_n_f32(key)) : vcltq_f32(v, vdupq_n_f32(key));
+				} else if constexpr(std::is_signed_v<T>){
+					const int32x4_t v = vld1q_s32(reinterpret_cast<const std::int32_t*>(keys.data() + b));
+					hit = Greater ? vcgtq_s32(v, vdupq_n_s32(key)) : vcltq_s32(v, vdupq_n_s32(key));
+				} else{
+					const uint32x4_t v = vld1q_u32(reinterpret_cast<const std::uint32_t*>(keys.data() + b));
+					hit = Greater ? vcgtq_u32(v, vdupq_n_u32(key)) : vcltq_u32(v, vdupq_n_u32(key));
+				}
+				hit = vandq_u32(hit, vcltq_u32(idx, n)); // ignore lanes past count
+				total = vsubq_u32(total, hit);           // true lanes are all-ones, i.e. -1
+				idx = vaddq_u32(idx, vdupq_n_u32(4));
+			}
+			return static_cast<std::size_t>(vaddvq_u32(total));
+		}
+#endif
+		// scalar fallback: a fixed-shape counting loop, which compilers autovectorize well
+		std::size_t r = 0;
+		for(std::size_t i = 0; i < count; ++i){
+			r += static_cast<std::size_t>(Greater ? (key < keys[i]) : (keys[i] < key));
+		}
+		return r;
+	}
+}
+
+namespace flat {
+	template<class T, class Compare = std::less<T>, class IndexT = uint32_t, std::size_t NodeWidth = 16>
+	class btree final{
+		static_assert(NodeWidth >= 3 && NodeWidth <= 64, "NodeWidth must be in [3, 64]");
+		static_assert(std::is_default_constructible_v<T> && std::is_move_assignable_v<T>,
+			"btree keeps keys in fixed arrays, so T must be default constructible and move assignable");
+		using Layout = index_layout<IndexT>;
+		using index_type = IndexT;
+
+	public:
+		using value_type = T;
+		using size_type = std::size_t;
+		using handle_type = index_type;
+		static constexpr handle_type npos = std::numeric_limits<index_type>::max();
+		static constexpr size_type node_width = NodeWidth;
+
+		btree() = default;
+
+		constexpr explicit btree(Compare cmp) noexcept(std::is_nothrow_move_constructible_v<Compare>)
+			: comp_(std::move(cmp)){}
+
+		[[nodiscard]] constexpr bool empty() const noexcept{ return alive_count_ == 0; }
+		[[nodiscard]] constexpr size_type size() const noexcept{ return alive_count_; }
+
+		// levels from root to leaf, 0 for an empty tree
+		[[nodiscard]] constexpr size_type height() const noexcept{
+			size_type h = 0;
+			for(index_type n = root_; n != null_idx; n = nodes_[n].leaf ? null_idx : nodes_[n].child[0]) ++h;
+			return h;
+		}
+
+		constexpr void clear() noexcept{
+			nodes_.clear();
+			slots_.clear();
+			root_ = null_idx;
+			free_node_ = null_idx;
+			free_slot_ = null_idx;
+			alive_count_ = 0;
+		}
+
+		void swap(btree& other) noexcept{
+			using std::swap;
+			swap(nodes_, other.nodes_);
+			swap(slots_, other.slots_);
+			swap(root_, other.root_);
+			swap(free_node_, other.free_node_);
+			swap(free_slot_, other.free_slot_);
+			swap(alive_count_, other.alive_count_);
+			swap(comp_, other.comp_);
+		}
+
+		// returns true if handle is valid AND matches the current generation of the slot
+		[[nodiscard]] constexpr bool is_handle_valid(handle_type handle) const noexcept{
+			if(handle == npos) return false;
+			index_type idx = Layout::unpack_index(handle);
+			index_type gen = Layout::unpack_gen(handle);
+			if(idx >= slots_.size()) return false;
+			return (slots_[idx].generation == gen) && slots_[idx].is_alive();
+		}
+
+		// Handle -> value. Const only: values are the keys, modifying one would break the order.
+		[[nodiscard]] constexpr const value_type* try_get(handle_type handle) const noexcept{
+			if(!is_handle_valid(handle)) return nullptr;
+			const Slot& s = slots_[Layout::unpack_index(handle)];
+			return &nodes_[s.node].keys[s.pos];
+		}
+
+		[[nodiscard]] const value_type& at(handle_type handle) const{
+			if(const value_type* p = try_get(handle)) return *p;
+			throw std::out_of_range("flat::btree::at - invalid/stale handle");
+		}
+
+		[[nodiscard]] constexpr bool contains(const value_type& key) const noexcept{
+			return find_(key).node != null_idx;
+		}
+
+		[[nodiscard]] constexpr handle_type find_handle(const value_type& key) const noexcept{
+			const auto e = find_(key);
+			return (e.node == null_idx) ? npos : handle_of_(e);
+		}
+
+		[[nodiscard]] constexpr const value_type* find_ptr(const value_type& key) const noexcept{
+			const auto e = find_(key);
+			return (e.node == null_idx) ? nullptr : &nodes_[e.node].keys[e.pos];
+		}
+
+		// First element for which !comp_(elem, key)
+		[[nodiscard]] constexpr handle_type lower_bound_handle(const value_type& key) const noexcept{
+			entry best{};
+			for(index_type n = root_; n != null_idx;){
+				const Node& x = nodes_[n];
+				const size_type r = rank_(x, key);
+				if(r < x.count){
+					best = {n, static_cast<index_type>(r)};
+					if(!comp_(key, x.keys[r])) break; // exact match is the answer
+				}
+				n = x.leaf ? null_idx : x.child[r];
+			}
+			return (best.node == null_idx) ? npos : handle_of_(best);
+		}
+
+		// First element for which comp_(key, elem)
+		[[nodiscard]] constexpr handle_type upper_bound_handle(const value_type& key) const noexcept{
+			entry best{};
+			for(index_type n = root_; n != null_idx;){
+				const Node& x = nodes_[n];
+				const size_type r = upper_rank_(x, key);
+				if(r < x.count) best = {n, static_cast<index_type>(r)};
+				n = x.leaf ? null_idx : x.child[r];
+			}
+			return (best.node == null_idx) ? npos : handle_of_(best);
+		}
+
+		[[nodiscard]] constexpr std::pair<handle_type, handle_type> equal_range_handle(const value_type& key) const noexcept{
+			return {lower_bound_handle(key), upper_bound_handle(key)};
+		}
+
+		// insert, returns {handle, inserted}
+		std::pair<handle_type, bool> insert(const value_type& v){ return insert_impl(v); }
+		std::pair<handle_type, bool> insert(value_type&& v){ return insert_impl(std::move(v)); }
+
+		template<class It>
+		size_type insert(It first, It last){
+			size_type inserted = 0;
+			for(; first != last; ++first){
+				inserted += insert(*first).second ? 1 : 0;
+			}
+			return inserted;
+		}
+
+		// erase by key - returns true if erased. Invalidates only the erased element's handle.
+		bool erase(const value_type& key){
+			if(root_ == null_idx) return false;
+			const bool erased = remove_(root_, key);
+			Node& r = nodes_[root_];
+			if(r.count == 0){ // shrink from the top
+				const index_type old = root_;
+				root_ = r.leaf ? null_idx : r.child[0];
+				free_node_slot_(old);
+			}
+			return erased;
+		}
+
+		template<class F>
+		constexpr void for_each_inorder(F&& f) const{
+			if(root_ != null_idx) inorder_(root_, f);
+		}
+
+	private:
+		static constexpr index_type null_idx = Layout::idx_mask;
+		static constexpr size_type max_keys = NodeWidth;
+		static constexpr size_type min_keys = (NodeWidth - 1) / 2; // for non-root nodes; 2 * min + 1 <= max, so merges fit
+
+		struct Node final{
+			std::array<value_type, NodeWidth> keys{};      // sorted, [0, count) are live
+			std::array<index_type, NodeWidth> slot{};      // handle slot owning each key
+			std::array<index_type, NodeWidth + 1> child{}; // [0, count] are live in inner nodes; child[0] is next_free when dead
+			index_type count = 0;
+			bool leaf = true;
+		};
+
+		// Handle indirection: keys move between nodes, slots don't.
+		struct Slot final{
+			// Generation logic: Even = Alive, Odd = Free (same as flat::bst).
+			index_type generation = Layout::wrap_gen(1);
+			index_type node = null_idx; // Acts as next_free when dead
+			index_type pos = 0;
+
+			constexpr bool is_alive() const noexcept{ return (generation % 2) == 0; }
+			constexpr void bump_generation() noexcept{ generation = Layout::wrap_gen(generation + 1); }
+		};
+
+		struct entry final{
+			index_type node = null_idx;
+			index_type pos = 0;
+		};
+
+		std::vector<Node> nodes_;
+		std::vector<Slot> slots_;
+		index_type root_ = null_idx;
+		index_type free_node_ = null_idx;
+		index_type free_slot_ = null_idx;
+		size_type alive_count_ = 0;
+		[[no_unique_address]] Compare comp_{};
+
+		// number of keys in x that order before key (lower bound position within the node)
+		constexpr size_type rank_(const Node& x, const value_type& key) const noexcept{
+			constexpr int order = detail::numeric_order<T, Compare>;
+			if constexpr(order != 0){
+				if(!std::is_constant_evaluated()) return detail::count_beyond<(order < 0)>(x.keys, x.count, key);
+			}
+			size_type r = 0;
+			for(size_type i = 0; i < x.count; ++i) r += static_cast<size_type>(comp_(x.keys[i], key));
+			return r;
+		}
+
+		// number of keys in x that do not order after key (upper bound position within the node)
+		constexpr size_type upper_rank_(const Node& x, const value_type& key) const noexcept{
+			constexpr int order = detail::numeric_order<T, Compare>;
+			if constexpr(order != 0){
+				if(!std::is_constant_evaluated()) return x.count - detail::count_beyond<(order > 0)>(x.keys, x.count, key);
+			}
+			size_type r = 0;
+			for(size_type i = 0; i < x.count; ++i) r += static_cast<size_type>(!comp_(key, x.keys[i]));
+			return r;
+		}
+
+		constexpr entry find_(const value_type& key) const noexcept{
+			for(index_type n = root_; n != null_idx;){
+				const Node& x = nodes_[n];
+				const size_type r = rank_(x, key);
+				if(r < x.count && !comp_(key, x.keys[r])) return {n, static_cast<index_type>(r)};
+				n = x.leaf ? null_idx : x.child[r];
+			}
+			return {};
+		}
+
+		constexpr handle_type handle_of_(entry e) const noexcept{
+			const index_type s = nodes_[e.node].slot[e.pos];
+			return Layout::pack(s, slots_[s].generation);
+		}
+
+		// tell the slot owning x.keys[pos] where its key lives now
+		constexpr void place_(index_type n, size_type pos) noexcept{
+			Slot& s = slots_[nodes_[n].slot[pos]];
+			s.node = n;
+			s.pos = static_cast<index_type>(pos);
+		}
+
+		constexpr void place_range_(index_type n, size_type first, size_type last) noexcept{
+			for(size_type i = first; i < last; ++i) place_(n, i);
+		}
+
+		void reserve_nodes_(size_type extra){
+			if(nodes_.capacity() - nodes_.size() >= extra) return;
+			if(nodes_.size() + extra >= static_cast<size_t>(null_idx)) throw std::length_error("btree node index overflow");
+			nodes_.reserve(std::max(nodes_.size() + extra, nodes_.capacity() * 2));
+		}
+
+		index_type allocate_node_(bool leaf){
+			index_type n;
+			if(free_node_ != null_idx){
+				n = free_node_;
+				free_node_ = nodes_[n].child[0];
+			} else{
+				assert(nodes_.size() < nodes_.capacity() && "reserve_nodes_ first");
+				nodes_.emplace_back();
+				n = static_cast<index_type>(nodes_.size() - 1);
+			}
+			nodes_[n].count = 0;
+			nodes_[n].leaf = leaf;
+			return n;
+		}
+
+		constexpr void free_node_slot_(index_type n) noexcept{
+			nodes_[n].count = 0;
+			nodes_[n].child[0] = free_node_;
+			free_node_ = n;
+		}
+
+		// reserve a slot before touching the tree, so a throwing push_back leaves it intact
+		index_type acquire_slot_(){
+			if(free_slot_ != null_idx){
+				const index_type s = free_slot_;
+				free_slot_ = slots_[s].node;
+				return s;
+			}
+			if(slots_.size() >= static_cast<size_t>(null_idx)) throw std::length_error("btree index overflow");
+			slots_.emplace_back();
+			return static_cast<index_type>(slots_.size() - 1);
+		}
+
+		constexpr void release_slot_(index_type s) noexcept{
+			Slot& sl = slots_[s];
+			sl.bump_generation(); // even -> odd
+			sl.node = free_slot_;
+			free_slot_ = s;
+		}
+
+		// split the full child i of parent p; the median moves up into p at position i
+		void split_child_(index_type p, size_type i){
+			const index_type y = nodes_[p].child[i];
+			const index_type z = allocate_node_(nodes_[y].leaf); // may reallocate nodes_, so index from here on
+			constexpr size_type mid = max_keys / 2;
+			Node& Y = nodes_[y];
+			Node& Z = nodes_[z];
+			Node& P = nodes_[p];
+
+			Z.count = static_cast<index_type>(max_keys - mid - 1);
+			for(size_type j = 0; j < Z.count; ++j){
+				Z.keys[j] = std::move(Y.keys[mid + 1 + j]);
+				Z.slot[j] = Y.slot[mid + 1 + j];
+			}
+			if(!Y.leaf){
+				for(size_type j = 0; j <= Z.count; ++j) Z.child[j] = Y.child[mid + 1 + j];
+			}
+			for(size_type j = P.count; j > i; --j){
+				P.keys[j] = std::move(P.keys[j - 1]);
+				P.slot[j] = P.slot[j - 1];
+				P.child[j + 1] = P.child[j];
+			}
+			P.keys[i] = std::move(Y.keys[mid]);
+			P.slot[i] = Y.slot[mid];
+			P.child[i + 1] = z;
+			++P.count;
+			Y.count = static_cast<index_type>(mid);
+
+			place_range_(z, 0, Z.count);
+			place_range_(p, i, P.count);
+		}
+
+		template<class V>
+		std::pair<handle_type, bool> insert_impl(V&& v){
+			// Important: don't move from v during comparisons
+			const value_type& key = v;
+			if(const auto e = find_(key); e.node != null_idx) return {handle_of_(e), false};
+
+			// an insert splits at most one node per level plus a new root; grab the memory up front
+			// so nothing below throws on allocation once we start reshaping the tree
+			reserve_nodes_(height() + 1);
+			const index_type s = acquire_slot_();
+			if(root_ == null_idx){
+				root_ = allocate_node_(true);
+			} else if(nodes_[root_].count == max_keys){
+				const index_type r = allocate_node_(false);
+				nodes_[r].child[0] = root_;
+				root_ = r;
+				split_child_(r, 0);
+			}
+
+			// descend, splitting full children on the way so there is always room for the new key
+			index_type n = root_;
+			while(!nodes_[n].leaf){
+				size_type r = rank_(nodes_[n], key);
+				if(nodes_[nodes_[n].child[r]].count == max_keys){
+					split_child_(n, r);
+					if(comp_(nodes_[n].keys[r], key)) ++r;
+				}
+				n = nodes_[n].child[r];
+			}
+
+			Node& x = nodes_[n];
+			const size_type r = rank_(x, key);
+			try{
+				x.keys[x.count] = std::forward<V>(v); // the spare spot past the live keys: a throw leaves x as it was
+			} catch(...){
+				slots_[s].node = free_slot_; // hand the still-free slot back
+				free_slot_ = s;
+				throw;
+			}
+			std::rotate(x.keys.begin() + r, x.keys.begin() + x.count, x.keys.begin() + x.count + 1);
+			for(size_type j = x.count; j > r; --j){ x.slot[j] = x.slot[j - 1]; }
+			x.slot[r] = s;
+			++x.count;
+			place_range_(n, r, x.count);
+
+			slots_[s].bump_generation(); // odd -> even
+			++alive_count_;
+			return {Layout::pack(s, slots_[s].generation), true};
+		}
+
+		// remove keys[pos] / slot[pos] (and the child right of it) from node n
+		constexpr void remove_at_(index_type n, size_type pos, bool drop_right_child) noexcept{
+			Node& x = nodes_[n];
+			for(size_type j = pos + 1; j < x.count; ++j){
+				x.keys[j - 1] = std::move(x.keys[j]);
+				x.slot[j - 1] = x.slot[j];
+				if(drop_right_child) x.child[j] = x.child[j + 1];
+			}
+			--x.count;
+			place_range_(n, pos, x.count);
+		}
+
+		// merge child i+1 and the separator keys[i] into child i
+		void merge_children_(index_type p, size_type i){
+			Node& P = nodes_[p];
+			const index_type y = P.child[i];
+			const index_type z = P.child[i + 1];
+			Node& Y = nodes_[y];
+			Node& Z = nodes_[z];
+			const size_type base = Y.count;
+			Y.keys[base] = std::move(P.keys[i]);
+			Y.slot[base] = P.slot[i];
+			for(size_type j = 0; j < Z.count; ++j){
+				Y.keys[base + 1 + j] = std::move(Z.keys[j]);
+				Y.slot[base + 1 + j] = Z.slot[j];
+			}
+			if(!Y.leaf){
+				for(size_type j = 0; j <= Z.count; ++j) Y.child[base + 1 + j] = Z.child[j];
+			}
+			Y.count = static_cast<index_type>(base + 1 + Z.count);
+			place_range_(y, base, Y.count);
+			remove_at_(p, i, true);
+			free_node_slot_(z);
+		}
+
+		// make sure child i of p holds more than min_keys before we descend into it.
+		// returns the child position to continue at (a merge with the left sibling shifts it)
+		size_type ensure_child_(index_type p, size_type i){
+			Node& P = nodes_[p];
+			Node& C = nodes_[P.child[i]];
+			if(C.count > min_keys) return i;
+
+			if(i > 0 && nodes_[P.child[i - 1]].count > min_keys){ // borrow from the left
+				Node& L = nodes_[P.child[i - 1]];
+				for(size_type j = C.count; j > 0; --j){
+					C.keys[j] = std::move(C.keys[j - 1]);
+					C.slot[j] = C.slot[j - 1];
+				}
+				if(!C.leaf){
+					for(size_type j = C.count + 1; j > 0; --j) C.child[j] = C.child[j - 1];
+					C.child[0] = L.child[L.count];
+				}
+				C.keys[0] = std::move(P.keys[i - 1]);
+				C.slot[0] = P.slot[i - 1];
+				++C.count;
+				P.keys[i - 1] = std::move(L.keys[L.count - 1]);
+				P.slot[i - 1] = L.slot[L.count - 1];
+				--L.count;
+				place_range_(P.child[i], 0, C.count);
+				place_(p, i - 1);
+				return i;
+			}
+			if(i < P.count && nodes_[P.child[i + 1]].count > min_keys){ // borrow from the right
+				Node& R = nodes_[P.child[i + 1]];
+				C.keys[C.count] = std::move(P.keys[i]);
+				C.slot[C.count] = P.slot[i];
+				if(!C.leaf) C.child[C.count + 1] = R.child[0];
+				++C.count;
+				P.keys[i] = std::move(R.keys[0]);
+				P.slot[i] = R.slot[0];
+				for(size_type j = 1; j < R.count; ++j){
+					R.keys[j - 1] = std::move(R.keys[j]);
+					R.slot[j - 1] = R.slot[j];
+				}
+				if(!R.leaf){
+					for(size_type j = 0; j < R.count; ++j) R.child[j] = R.child[j + 1];
+				}
+				--R.count;
+				place_(P.child[i], C.count - 1);
+				place_(p, i);
+				place_range_(P.child[i + 1], 0, R.count);
+				return i;
+			}
+			if(i < P.count){
+				merge_children_(p, i);
+				return i;
+			}
+			merge_children_(p, i - 1);
+			return i - 1;
+		}
+
+		// detach the largest (or smallest) key of the subtree at n into the caller's entry
+		// n must hold more than min_keys, or be the root
+		std::pair<value_type, index_type> take_extreme_(index_type n, bool largest){
+			while(!nodes_[n].leaf){
+				const size_type i = largest ? nodes_[n].count : 0;
+				n = nodes_[n].child[ensure_child_(n, i)];
+			}
+			Node& x = nodes_[n];
+			const size_type pos = largest ? x.count - 1 : 0;
+			std::pair<value_type, index_type> out{std::move(x.keys[pos]), x.slot[pos]};
+			remove_at_(n, pos, false);
+			return out;
+		}
+
+		// CLRS-style top-down delete: every node we enter can afford to lose a key. A single descent,
+		// returns false if key is missing (the nodes topped up on the way down stay valid)
+		bool remove_(index_type n, const value_type& key){
+			while(true){
+				Node& x = nodes_[n];
+				const size_type r = rank_(x, key);
+				const bool here = r < x.count && !comp_(key, x.keys[r]);
+				if(!here && x.leaf) return false;
+				if(here && x.leaf){
+					release_slot_(x.slot[r]);
+					--alive_count_;
+					remove_at_(n, r, false);
+					return true;
+				}
+				if(here){
+					const index_type left = x.child[r];
+					const index_type right = x.child[r + 1];
+					if(nodes_[left].count > min_keys || nodes_[right].count > min_keys){
+						// replace with the predecessor or successor, which is always in a leaf
+						release_slot_(x.slot[r]);
+						--alive_count_;
+						auto [k, s] = take_extreme_(nodes_[left].count > min_keys ? left : right, nodes_[left].count > min_keys);
+						Node& xx = nodes_[n];
+						xx.keys[r] = std::move(k);
+						xx.slot[r] = s;
+						place_(n, r);
+						return true;
+					}
+					merge_children_(n, r); // key moves down into the merged child
+					n = left;
+					continue;
+				}
+				n = x.child[ensure_child_(n, r)];
+			}
+		}
+
+		template<class F>
+		constexpr void inorder_(index_type n, F& f) const{
+			const Node& x = nodes_[n];
+			for(size_type i = 0; i < x.count; ++i){
+				if(!x.leaf) inorder_(x.child[i], f);
+				f(x.keys[i]);
+			}
+			if(!x.leaf) inorder_(x.child[x.count], f);
+		}
+	};
+
+	template<class T, class Compare, class IndexT, std::size_t NodeWidth>
+	void swap(btree<T, Compare, IndexT, NodeWidth>& a, btree<T, Compare, IndexT, NodeWidth>& b)
+		noexcept(noexcept(a.swap(b))){
+		a.swap(b);
+	}
+}
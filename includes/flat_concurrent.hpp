@@ -0,0 +1,145 @@
+// flat::concurrent_bst<T, Compare, IndexT, Policy> - one writer, many lock-free readers
+// The writer edits a private flat::bst and publish()es a copy of it as an immutable snapshot.
+// Readers pin the current snapshot for the lifetime of a read_guard and never block, the writer
+// frees a retired snapshot (or reuses its storage for the next one) once no reader that could
+// still see it is pinned (epoch-based reclamation). Each publish copies the whole tree, so this
+// suits read-mostly use: batch edits, then publish. Slot copies keep indices and generations, so
+// handles from one snapshot stay valid in the working tree and in later snapshots.
+// Requires C++20. See test.cpp for usage examples.
+
+#pragma once
+#include "flat_bst.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace flat {
+	template<class T, class Compare = std::less<T>, class IndexT = uint32_t, class Policy = default_policy>
+	class concurrent_bst final{
+		struct reader_slot_;
+	public:
+		using tree_type = bst<T, Compare, IndexT, Policy>;
+		using size_type = typename tree_type::size_type;
+		using reader_id = std::size_t;
+
+		// a pinned snapshot. Unpins on destruction, at most one guard per reader_id at a time
+		class read_guard final{
+		public:
+			read_guard(const read_guard&) = delete;
+			read_guard& operator=(const read_guard&) = delete;
+			~read_guard(){ slot_->epoch.store(idle, std::memory_order_release); }
+
+			[[nodiscard]] const tree_type& operator*() const noexcept{ return *tree_; }
+			[[nodiscard]] const tree_type* operator->() const noexcept{ return tree_; }
+
+		private:
+			friend class concurrent_bst;
+			read_guard(const tree_type* tree, const reader_slot_* slot) noexcept : tree_(tree), slot_(slot){}
+			const tree_type* tree_;
+			const reader_slot_* slot_;
+		};
+
+		explicit concurrent_bst(std::size_t max_readers = 64, Compare cmp = Compare{})
+			: working_(cmp), readers_(max_readers){
+			current_.store(new tree_type(working_), std::memory_order_seq_cst);
+		}
+		concurrent_bst(const concurrent_bst&) = delete;
+		concurrent_bst& operator=(const concurrent_bst&) = delete;
+		~concurrent_bst(){ // readers must be gone by now
+			delete current_.load(std::memory_order_relaxed);
+		}
+
+		// reader side, any thread. throws std::length_error when all max_readers ids are taken
+		[[nodiscard]] reader_id register_reader(){
+			for(std::size_t i = 0; i < readers_.size(); ++i){
+				bool expected = false;
+				if(readers_[i].taken.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) return i;
+			}
+			throw std::length_error("concurrent_bst: no free reader slot");
+		}
+		void unregister_reader(reader_id id) noexcept{
+			assert(readers_[id].epoch.load() == idle && "reader still holds a read_guard");
+			readers_[id].taken.store(false, std::memory_order_release);
+		}
+
+		// pin the current snapshot: two atomic stores and two loads, no lock and no shared counter
+		[[nodiscard]] read_guard read(reader_id id) const noexcept{
+			const reader_slot_& r = readers_[id];
+			assert(r.taken.load(std::memory_order_relaxed) && r.epoch.load(std::memory_order_relaxed) == idle);
+			// announce first, then load: a writer either sees the pin or has already swapped the pointer
+			r.epoch.store(epoch_.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+			return read_guard(current_.load(std::memory_order_seq_cst), &r);
+		}
+
+		// writer side, one thread only. edits stay invisible to readers until publish()
+		[[nodiscard]] tree_type& edit() noexcept{ return working_; }
+		[[nodiscard]] const tree_type& working() const noexcept{ return working_; }
+
+		// make the working tree the snapshot new reads see, then free what no reader can reach anymore
+		void publish(){
+			std::unique_ptr<tree_type> next = reuse_or_copy_();
+			retired_.reserve(retired_.size() + 1); // nothing below may throw once the pointer is swapped
+			const tree_type* old = current_.exchange(next.release(), std::memory_order_seq_cst);
+			const std::uint64_t e = epoch_.fetch_add(1, std::memory_order_seq_cst); // readers pinned at <= e may hold old
+			retired_.push_back({e, std::unique_ptr<tree_type>(const_cast<tree_type*>(old))});
+			reclaim_();
+		}
+
+		// snapshots published but not yet freed, for tests and monitoring
+		[[nodiscard]] size_type retired_count() const noexcept{ return retired_.size(); }
+
+	private:
+		static constexpr std::uint64_t idle = ~std::uint64_t{0};
+
+		struct alignas(64) reader_slot_ final{ // one cache line each, so readers never share one
+			mutable std::atomic<std::uint64_t> epoch{idle};
+			std::atomic<bool> taken{false};
+		};
+		struct retired_tree final{
+			std::uint64_t epoch;
+			std::unique_ptr<tree_type> tree;
+		};
+
+		tree_type working_;
+		std::vector<reader_slot_> readers_;
+		std::atomic<const tree_type*> current_{nullptr};
+		std::atomic<std::uint64_t> epoch_{0};
+		std::vector<retired_tree> retired_;
+		std::unique_ptr<tree_type> spare_; // a freed snapshot whose storage the next publish reuses
+
+		std::unique_ptr<tree_type> reuse_or_copy_(){
+			if(spare_){
+				*spare_ = working_; // copy-assign keeps the vectors' capacity
+				return std::move(spare_);
+			}
+			return std::make_unique<tree_type>(working_);
+		}
+
+		// the oldest epoch any reader still has pinned
+		std::uint64_t min_pinned_() const noexcept{
+			std::uint64_t m = idle;
+			for(const reader_slot_& r : readers_){ m = std::min(m, r.epoch.load(std::memory_order_seq_cst)); }
+			return m;
+		}
+
+		void reclaim_() noexcept{
+			const std::uint64_t pinned = min_pinned_();
+			std::size_t kept = 0;
+			for(retired_tree& r : retired_){
+				if(r.epoch < pinned){
+					if(!spare_) spare_ = std::move(r.tree);
+					r.tree.reset();
+				} else{
+					retired_[kept++] = std::move(r);
+				}
+			}
+			retired_.erase(retired_.begin() + static_cast<std::ptrdiff_t>(kept), retired_.end());
+		}
+	};
+}
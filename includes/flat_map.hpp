@@ -0,0 +1,162 @@
+// flat::map<Key, T, Compare, IndexT, Policy> - an ordered map on the flat::bst slot/handle machinery
+// Each entry is one std::pair<const Key, T> in its slot, searched by .first (key_policy). try_emplace,
+// insert_or_assign and operator[] search by key first and only build a pair on a real insert.
+// Iteration is read-only, reach the mapped values through operator[], at, find_ptr or a handle.
+// Requires C++20. See test.cpp for usage examples.
+
+#pragma once
+#include "flat_bst.hpp"
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+namespace flat {
+	template<class Key, class T, class Compare = std::less<Key>, class IndexT = uint32_t, class Policy = default_policy>
+	class map final{
+		struct key_of_pair final{
+			constexpr const Key& operator()(const std::pair<const Key, T>& p) const noexcept{ return p.first; }
+		};
+		using tree_type = bst<std::pair<const Key, T>, Compare, IndexT, key_policy<key_of_pair, Policy>>;
+
+	public:
+		using key_type = Key;
+		using mapped_type = T;
+		using value_type = std::pair<const Key, T>;
+		using size_type = typename tree_type::size_type;
+		using handle_type = typename tree_type::handle_type;
+		using const_iterator = typename tree_type::const_inorder_iterator;
+		using const_reverse_iterator = typename tree_type::const_reverse_inorder_iterator;
+		static constexpr handle_type npos = tree_type::npos;
+
+		map() = default;
+		constexpr explicit map(Compare cmp) : tree_(std::move(cmp)){}
+		map(std::initializer_list<value_type> values, Compare cmp = Compare{}) : tree_(values.begin(), values.end(), std::move(cmp)){}
+
+		[[nodiscard]] constexpr bool empty() const noexcept{ return tree_.empty(); }
+		[[nodiscard]] constexpr size_type size() const noexcept{ return tree_.size(); }
+		[[nodiscard]] constexpr size_type capacity() const noexcept{ return tree_.capacity(); }
+		constexpr void reserve(size_type n){ tree_.reserve(n); }
+		constexpr void clear() noexcept{ tree_.clear(); }
+		constexpr void swap(map& other) noexcept{ tree_.swap(other.tree_); }
+		constexpr const_iterator begin() const{ return tree_.begin(); }
+		constexpr const_iterator end() const{ return tree_.end(); }
+		constexpr const_reverse_iterator rbegin() const{ return tree_.rbegin(); }
+		constexpr const_reverse_iterator rend() const{ return tree_.rend(); }
+
+		[[nodiscard]] constexpr bool is_handle_valid(handle_type h) const noexcept{ return tree_.is_handle_valid(h); }
+		[[nodiscard]] constexpr const value_type* try_get(handle_type h) const noexcept{ return tree_.try_get(h); }
+		[[nodiscard]] constexpr value_type* try_get(handle_type h) noexcept{ return tree_.try_get(h); }
+
+		[[nodiscard]] constexpr bool contains(const Key& key) const noexcept{ return tree_.contains_(key); }
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] constexpr bool contains(const K& key) const noexcept{ return tree_.contains_(key); }
+
+		[[nodiscard]] constexpr handle_type find_handle(const Key& key) const noexcept{ return tree_.find_handle_(key); }
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] constexpr handle_type find_handle(const K& key) const noexcept{ return tree_.find_handle_(key); }
+
+		// the mapped value for key, or nullptr
+		[[nodiscard]] constexpr T* find_ptr(const Key& key) noexcept{ return mapped_(tree_.find_handle_(key)); }
+		[[nodiscard]] constexpr const T* find_ptr(const Key& key) const noexcept{ return mapped_(tree_.find_handle_(key)); }
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] constexpr T* find_ptr(const K& key) noexcept{ return mapped_(tree_.find_handle_(key)); }
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] constexpr const T* find_ptr(const K& key) const noexcept{ return mapped_(tree_.find_handle_(key)); }
+
+		// throws std::out_of_range if key is absent
+		[[nodiscard]] constexpr T& at(const Key& key){ return at_(*this, key); }
+		[[nodiscard]] constexpr const T& at(const Key& key) const{ return at_(*this, key); }
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] constexpr T& at(const K& key){ return at_(*this, key); }
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] constexpr const T& at(const K& key) const{ return at_(*this, key); }
+
+		// builds T from args only if key is absent, returns {handle, inserted}
+		template<class... Args>
+		constexpr std::pair<handle_type, bool> try_emplace(const Key& key, Args&&... args){ return try_emplace_(key, key, std::forward<Args>(args)...); }
+		template<class... Args>
+		constexpr std::pair<handle_type, bool> try_emplace(Key&& key, Args&&... args){ return try_emplace_(key, std::move(key), std::forward<Args>(args)...); }
+
+		template<class M>
+		constexpr std::pair<handle_type, bool> insert_or_assign(const Key& key, M&& obj){ return insert_or_assign_(key, key, std::forward<M>(obj)); }
+		template<class M>
+		constexpr std::pair<handle_type, bool> insert_or_assign(Key&& key, M&& obj){ return insert_or_assign_(key, std::move(key), std::forward<M>(obj)); }
+
+		// value-initializes T on a miss
+		constexpr T& operator[](const Key& key){ return *mapped_(try_emplace(key).first); }
+		constexpr T& operator[](Key&& key){ return *mapped_(try_emplace(std::move(key)).first); }
+
+		constexpr std::pair<handle_type, bool> insert(const value_type& v){ return tree_.insert(v); }
+		constexpr std::pair<handle_type, bool> insert(value_type&& v){ return tree_.insert(std::move(v)); }
+
+		constexpr bool erase(const Key& key){ return tree_.erase_key_(key); }
+		template<class K> requires detail::transparent<Compare>
+		constexpr bool erase(const K& key){ return tree_.erase_key_(key); }
+
+		[[nodiscard]] constexpr const_iterator lower_bound(const Key& key) const noexcept{ return tree_.lower_bound_iter_(key); }
+		[[nodiscard]] constexpr const_iterator upper_bound(const Key& key) const noexcept{ return tree_.upper_bound_iter_(key); }
+
+		// visits the pairs with keys in [lo, hi)
+		template<class F>
+		constexpr void for_each_in_range(const Key& lo, const Key& hi, F&& f) const{ tree_.for_each_in_range_(lo, hi, f); }
+
+		// with augment_policy: Monoid over the pairs with keys in [lo, hi). After changing a mapped value
+		// in place, refresh(handle) repairs the aggregates above it
+		[[nodiscard]] constexpr auto aggregate(const Key& lo, const Key& hi) const noexcept requires requires{ typename Policy::augment; }{
+			return tree_.aggregate_(lo, hi);
+		}
+		constexpr bool refresh(handle_type h) noexcept requires requires{ typename Policy::augment; }{ return tree_.refresh(h); }
+
+		// with maintenance_policy: see bst::maintenance_due(), maintain() and on_maintenance_due()
+		[[nodiscard]] constexpr maintenance_reason maintenance_due() const noexcept requires requires{ typename Policy::maintenance; }{
+			return tree_.maintenance_due();
+		}
+		constexpr maintenance_reason maintain() requires requires{ typename Policy::maintenance; }{ return tree_.maintain(); }
+		void on_maintenance_due(std::function<void(maintenance_reason)> f) requires requires{ typename Policy::maintenance; }{
+			tree_.on_maintenance_due(std::move(f));
+		}
+
+	private:
+		tree_type tree_;
+
+		constexpr T* mapped_(handle_type h) noexcept{
+			value_type* p = tree_.try_get(h);
+			return p ? &p->second : nullptr;
+		}
+		constexpr const T* mapped_(handle_type h) const noexcept{
+			const value_type* p = tree_.try_get(h);
+			return p ? &p->second : nullptr;
+		}
+
+		template<class Self, class K>
+		static constexpr auto& at_(Self& self, const K& key){
+			auto* p = self.mapped_(self.tree_.find_handle_(key));
+			if(!p) throw std::out_of_range("flat::map::at: key not found");
+			return *p;
+		}
+
+		// probe is the key as stored; kf is the same key, forwarded into the pair on a real insert
+		template<class KF, class... Args>
+		constexpr std::pair<handle_type, bool> try_emplace_(const Key& probe, KF&& kf, Args&&... args){
+			return tree_.insert_with_(probe, [&]{
+				return tree_.allocate_node(std::piecewise_construct,
+					std::forward_as_tuple(std::forward<KF>(kf)), std::forward_as_tuple(std::forward<Args>(args)...));
+				});
+		}
+
+		template<class KF, class M>
+		constexpr std::pair<handle_type, bool> insert_or_assign_(const Key& probe, KF&& kf, M&& obj){
+			auto r = try_emplace_(probe, std::forward<KF>(kf), std::forward<M>(obj));
+			if(!r.second) *mapped_(r.first) = std::forward<M>(obj); // obj was not consumed: the miss path never ran
+			return r;
+		}
+	};
+
+	template<class Key, class T, class Compare, class IndexT, class Policy>
+	constexpr void swap(map<Key, T, Compare, IndexT, Policy>& a, map<Key, T, Compare, IndexT, Policy>& b) noexcept{
+		a.swap(b);
+	}
+}
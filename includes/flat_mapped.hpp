@@ -0,0 +1,270 @@
+// flat::mapped_bst<T, Compare, IndexT> - a read-only flat::bst served straight from a bst::save() file
+// open() maps the file and looks values up in place: no parsing, no allocation per value, startup
+// is page faults instead of a rebuild, and processes mapping the same file share its page cache.
+// The slots keep the positions they had when saved, so handles from the saved tree stay valid.
+// T must be trivially copyable and the file written by the same build (layout, byte order).
+// Requires C++20. See test.cpp for usage examples.
+
+#pragma once
+#include "flat_bst.hpp"
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace flat {
+	template<class T, class Compare = std::less<T>, class IndexT = uint32_t>
+	class mapped_bst final{
+		static_assert(std::is_trivially_copyable_v<T>, "mapped_bst reads T's bytes in place");
+		using Layout = index_layout<IndexT>;
+		using record = detail::mapped_slot<T, IndexT>;
+		static constexpr IndexT null_idx = Layout::idx_mask;
+	public:
+		using value_type = T;
+		using size_type = std::size_t;
+		using handle_type = IndexT;
+		static constexpr handle_type npos = std::numeric_limits<IndexT>::max();
+
+		// full rehashes every record on open, header only checks the header and sizes and trusts the rest
+		enum class check : uint8_t{ full, header };
+
+		// view bytes kept alive by the caller (a buffer, or a mapping made elsewhere).
+		// throws std::runtime_error if they are not a valid file for this instantiation
+		explicit mapped_bst(std::span<const std::byte> bytes, check c = check::full, Compare cmp = Compare{})
+			: comp_(std::move(cmp)){
+			attach_(bytes, c);
+		}
+
+		// map path read-only for the lifetime of the returned object
+		[[nodiscard]] static mapped_bst open(const std::string& path, check c = check::full, Compare cmp = Compare{}){
+			mapped_bst out(std::move(cmp));
+			out.map_.open(path);
+			out.attach_(out.map_.bytes(), c);
+			return out;
+		}
+
+		mapped_bst(mapped_bst&& other) noexcept{ *this = std::move(other); }
+		mapped_bst& operator=(mapped_bst&& other) noexcept{
+			if(this != &other){
+				map_ = std::move(other.map_);
+				slots_ = std::exchange(other.slots_, nullptr);
+				slot_count_ = std::exchange(other.slot_count_, 0);
+				alive_count_ = std::exchange(other.alive_count_, 0);
+				root_ = std::exchange(other.root_, null_idx);
+				comp_ = std::move(other.comp_);
+			}
+			return *this;
+		}
+		mapped_bst(const mapped_bst&) = delete;
+		mapped_bst& operator=(const mapped_bst&) = delete;
+		~mapped_bst() = default;
+
+		[[nodiscard]] size_type size() const noexcept{ return alive_count_; }
+		[[nodiscard]] bool empty() const noexcept{ return alive_count_ == 0; }
+
+		[[nodiscard]] bool contains(const value_type& key) const noexcept{ return find_(key) != nullptr; }
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] bool contains(const K& key) const noexcept{ return find_(key) != nullptr; }
+
+		[[nodiscard]] const value_type* find(const value_type& key) const noexcept{ return find_(key); }
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] const value_type* find(const K& key) const noexcept{ return find_(key); }
+
+		// first element not less than key / greater than key, or nullptr
+		[[nodiscard]] const value_type* lower_bound(const value_type& key) const noexcept{ return bound_(key, [&](const T& v, const auto& k){ return !comp_(v, k); }); }
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] const value_type* lower_bound(const K& key) const noexcept{ return bound_(key, [&](const T& v, const auto& k){ return !comp_(v, k); }); }
+		[[nodiscard]] const value_type* upper_bound(const value_type& key) const noexcept{ return bound_(key, [&](const T& v, const auto& k){ return comp_(k, v); }); }
+		template<class K> requires detail::transparent<Compare>
+		[[nodiscard]] const value_type* upper_bound(const K& key) const noexcept{ return bound_(key, [&](const T& v, const auto& k){ return comp_(k, v); }); }
+
+		// handles issued by the tree that was saved
+		[[nodiscard]] const value_type* try_get(handle_type h) const noexcept{
+			if(h == npos) return nullptr;
+			const IndexT idx = Layout::unpack_index(h);
+			if(idx >= slot_count_) return nullptr;
+			const record& r = slots_[idx];
+			const bool alive = r.generation % 2 == 0;
+			return alive && Layout::wrap_gen(r.generation) == Layout::unpack_gen(h) ? &r.value : nullptr;
+		}
+
+		template<class F>
+		void for_each_inorder(F&& f) const{
+			std::vector<IndexT> stack;
+			stack.reserve(16);
+			for(IndexT i = root_; i != null_idx; i = slots_[i].left){ stack.push_back(i); }
+			while(!stack.empty()){
+				const IndexT i = stack.back();
+				stack.pop_back();
+				f(slots_[i].value);
+				for(IndexT j = slots_[i].right; j != null_idx; j = slots_[j].left){ stack.push_back(j); }
+			}
+		}
+
+		// visits [lo, hi) after one descent to lo
+		template<class F>
+		void for_each_in_range(const value_type& lo, const value_type& hi, F&& f) const{ for_each_in_range_(lo, hi, f); }
+		template<class K, class F> requires detail::transparent<Compare>
+		void for_each_in_range(const K& lo, const K& hi, F&& f) const{ for_each_in_range_(lo, hi, f); }
+
+	private:
+		// owns an OS mapping, empty when viewing caller-owned bytes
+		class file_map_ final{
+		public:
+			file_map_() = default;
+			file_map_(file_map_&& o) noexcept{ *this = std::move(o); }
+			file_map_& operator=(file_map_&& o) noexcept{
+				if(this != &o){
+					close_();
+					data_ = std::exchange(o.data_, nullptr);
+					size_ = std::exchange(o.size_, 0);
+#if defined(_WIN32)
+					mapping_ = std::exchange(o.mapping_, nullptr);
+#endif
+				}
+				return *this;
+			}
+			~file_map_(){ close_(); }
+
+			void open(const std::string& path){
+#if defined(_WIN32)
+				HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+				if(file == INVALID_HANDLE_VALUE) throw std::runtime_error("flat::mapped_bst: cannot open " + path);
+				LARGE_INTEGER len{};
+				if(!GetFileSizeEx(file, &len)){ CloseHandle(file); throw std::runtime_error("flat::mapped_bst: cannot stat " + path); }
+				size_ = static_cast<std::size_t>(len.QuadPart);
+				if(size_ == 0){ CloseHandle(file); return; }
+				mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				CloseHandle(file); // the mapping keeps the file open
+				if(!mapping_) throw std::runtime_error("flat::mapped_bst: cannot map " + path);
+				data_ = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+				if(!data_){ close_(); throw std::runtime_error("flat::mapped_bst: cannot map " + path); }
+#else
+				const int fd = ::open(path.c_str(), O_RDONLY);
+				if(fd < 0) throw std::runtime_error("flat::mapped_bst: cannot open " + path);
+				struct stat st{};
+				if(::fstat(fd, &st) != 0){ ::close(fd); throw std::runtime_error("flat::mapped_bst: cannot stat " + path); }
+				size_ = static_cast<std::size_t>(st.st_size);
+				if(size_ == 0){ ::close(fd); return; }
+				void* p = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+				::close(fd); // the mapping keeps the file open
+				if(p == MAP_FAILED){ size_ = 0; throw std::runtime_error("flat::mapped_bst: cannot map " + path); }
+				data_ = p;
+#endif
+			}
+
+			[[nodiscard]] std::span<const std::byte> bytes() const noexcept{ return {static_cast<const std::byte*>(data_), size_}; }
+
+		private:
+			void* data_ = nullptr;
+			std::size_t size_ = 0;
+#if defined(_WIN32)
+			HANDLE mapping_ = nullptr;
+#endif
+
+			void close_() noexcept{
+#if defined(_WIN32)
+				if(data_) UnmapViewOfFile(data_);
+				if(mapping_) CloseHandle(mapping_);
+				mapping_ = nullptr;
+#else
+				if(data_) ::munmap(data_, size_);
+#endif
+				data_ = nullptr;
+				size_ = 0;
+			}
+		};
+
+		file_map_ map_;
+		const record* slots_ = nullptr;
+		size_type slot_count_ = 0;
+		size_type alive_count_ = 0;
+		IndexT root_ = null_idx;
+		[[no_unique_address]] Compare comp_;
+
+		explicit mapped_bst(Compare cmp) : comp_(std::move(cmp)){}
+
+		void attach_(std::span<const std::byte> bytes, check c){
+			using header = detail::mapped_header;
+			auto fail = [](const char* what){ throw std::runtime_error(std::string("flat::mapped_bst: ") + what); };
+			if(bytes.size() < sizeof(header)) fail("file too small for a header");
+			header h;
+			std::memcpy(&h, bytes.data(), sizeof(h));
+			if(std::memcmp(h.magic, header::magic_value, sizeof(h.magic)) != 0) fail("not a flat::bst file");
+			if(h.version != header::current_version) fail("unsupported format version");
+			if(h.byte_order != header::byte_order_mark) fail("written with a different byte order");
+			if(h.index_bytes != sizeof(IndexT) || h.value_bytes != sizeof(T) || h.value_align != alignof(T) || h.record_bytes != sizeof(record)){
+				fail("written for a different IndexT or value type");
+			}
+			if(h.slot_count > (bytes.size() - sizeof(header)) / sizeof(record)) fail("truncated slot array");
+			if(h.slot_count > null_idx || h.alive_count > h.slot_count) fail("corrupt header counts");
+			if(h.root != null_idx && h.root >= h.slot_count) fail("corrupt root index");
+			if(reinterpret_cast<std::uintptr_t>(bytes.data()) % alignof(record) != 0) fail("buffer is not aligned for the slot records");
+			const auto* first = reinterpret_cast<const record*>(bytes.data() + sizeof(header));
+			if(c == check::full && detail::fnv1a(first, static_cast<std::size_t>(h.slot_count) * sizeof(record)) != h.checksum){
+				fail("checksum mismatch");
+			}
+			slots_ = first;
+			slot_count_ = static_cast<size_type>(h.slot_count);
+			alive_count_ = static_cast<size_type>(h.alive_count);
+			root_ = static_cast<IndexT>(h.root);
+		}
+
+		template<class K>
+		const value_type* find_(const K& key) const noexcept{
+			for(IndexT i = root_; i != null_idx;){
+				const record& r = slots_[i];
+				if(comp_(key, r.value)){ i = r.left; } else if(comp_(r.value, key)){ i = r.right; } else{ return &r.value; }
+			}
+			return nullptr;
+		}
+
+		// first element for which at_or_after(v, key) holds
+		template<class K, class AtOrAfter>
+		const value_type* bound_(const K& key, AtOrAfter&& at_or_after) const noexcept{
+			const value_type* best = nullptr;
+			for(IndexT i = root_; i != null_idx;){
+				const record& r = slots_[i];
+				if(at_or_after(r.value, key)){ best = &r.value; i = r.left; } else{ i = r.right; }
+			}
+			return best;
+		}
+
+		template<class K, class F>
+		void for_each_in_range_(const K& lo, const K& hi, F& f) const{
+			// prune left of lo while descending, stop at the first value not below hi
+			std::vector<IndexT> stack;
+			for(IndexT i = root_; i != null_idx;){
+				if(comp_(slots_[i].value, lo)){ i = slots_[i].right; } else{ stack.push_back(i); i = slots_[i].left; }
+			}
+			while(!stack.empty()){
+				const IndexT i = stack.back();
+				stack.pop_back();
+				if(!comp_(slots_[i].value, hi)) return;
+				f(slots_[i].value);
+				for(IndexT j = slots_[i].right; j != null_idx; j = slots_[j].left){ stack.push_back(j); }
+			}
+		}
+	};
+}
@@ -0,0 +1,169 @@
+// flat::sharded_bst<T, Compare, IndexT, Policy> - N range-partitioned flat::bst shards, one lock each
+// Split keys cut the key space into shards, so writers on different ranges never touch the same
+// slots_ vector or lock, and in-order visits walk the shards left to right. Handles carry their
+// shard id above the shard-local index/generation bits, so handle lookups go straight to one shard.
+// Every call locks its shard; do not call back into the same shard from inside a callback.
+// Requires C++20. See test.cpp for usage examples.
+
+#pragma once
+#include "flat_bst.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace flat {
+	// sharded handle: [ shard id | shard-local handle ], the local handle keeps index_layout<IndexT>'s split
+	template<class IndexT>
+	struct shard_layout final{
+		static_assert(std::numeric_limits<IndexT>::digits <= 32, "shard ids need spare bits above IndexT in a 64-bit handle");
+		using handle_type = std::uint64_t;
+		static constexpr int local_bits = std::numeric_limits<IndexT>::digits;
+		static constexpr int shard_bits = 64 - local_bits;
+
+		static constexpr handle_type pack(std::size_t shard, IndexT local) noexcept{ return (handle_type(shard) << local_bits) | local; }
+		static constexpr std::size_t unpack_shard(handle_type h) noexcept{ return static_cast<std::size_t>(h >> local_bits); }
+		static constexpr IndexT unpack_local(handle_type h) noexcept{ return static_cast<IndexT>(h); }
+	};
+
+	template<class T, class Compare = std::less<T>, class IndexT = uint32_t, class Policy = default_policy>
+	class sharded_bst final{
+	public:
+		using tree_type = bst<T, Compare, IndexT, Policy>;
+		using value_type = T;
+		using key_type = typename tree_type::key_type;
+		using size_type = typename tree_type::size_type;
+		using Layout = shard_layout<IndexT>;
+		using handle_type = typename Layout::handle_type;
+		static constexpr handle_type npos = std::numeric_limits<handle_type>::max();
+
+		// splits must be strictly increasing. shard i holds the keys in [splits[i - 1], splits[i]),
+		// so there are splits.size() + 1 shards
+		explicit sharded_bst(std::vector<key_type> splits, Compare cmp = Compare{})
+			: splits_(std::move(splits)), shards_(splits_.size() + 1), comp_(cmp){
+			if(shards_.size() > (size_type{1} << std::min(Layout::shard_bits, 62))) throw std::length_error("sharded_bst: too many shards");
+			assert(std::adjacent_find(splits_.begin(), splits_.end(), [&](const key_type& a, const key_type& b){ return !comp_(a, b); }) == splits_.end()
+				&& "splits must be strictly increasing");
+			for(shard_& s : shards_){ s.tree = tree_type(cmp); }
+		}
+
+		[[nodiscard]] size_type shard_count() const noexcept{ return shards_.size(); }
+
+		// which shard owns key (a value, or a bare key with a transparent Compare)
+		template<class K>
+		[[nodiscard]] size_type shard_of(const K& key) const noexcept{
+			const auto& k = key_of_(key);
+			return static_cast<size_type>(std::upper_bound(splits_.begin(), splits_.end(), k,
+				[&](const auto& probe, const key_type& split){ return comp_(probe, split); }) - splits_.begin());
+		}
+		[[nodiscard]] static constexpr size_type shard_of_handle(handle_type h) noexcept{ return Layout::unpack_shard(h); }
+
+		std::pair<handle_type, bool> insert(const value_type& v){ return insert_(v); }
+		std::pair<handle_type, bool> insert(value_type&& v){ return insert_(std::move(v)); }
+
+		template<class K = value_type>
+		bool erase(const K& key){
+			const size_type i = shard_of(key);
+			std::lock_guard lock(shards_[i].mutex);
+			return shards_[i].tree.erase(key);
+		}
+
+		template<class K = value_type>
+		[[nodiscard]] bool contains(const K& key) const{
+			const size_type i = shard_of(key);
+			std::lock_guard lock(shards_[i].mutex);
+			return shards_[i].tree.contains(key);
+		}
+
+		template<class K = value_type>
+		[[nodiscard]] handle_type find_handle(const K& key) const{
+			const size_type i = shard_of(key);
+			std::lock_guard lock(shards_[i].mutex);
+			const auto local = shards_[i].tree.find_handle(key);
+			return local == tree_type::npos ? npos : Layout::pack(i, local);
+		}
+
+		// routed by the handle's shard bits, no search. Values are copied out: a pointer would outlive the lock
+		[[nodiscard]] std::optional<value_type> try_get(handle_type h) const{
+			std::optional<value_type> out;
+			visit(h, [&](const value_type& v){ out.emplace(v); });
+			return out;
+		}
+		// throws std::out_of_range for stale or foreign handles
+		[[nodiscard]] value_type at(handle_type h) const{
+			if(auto v = try_get(h)) return *std::move(v);
+			throw std::out_of_range("sharded_bst::at: invalid handle");
+		}
+		// f(const value_type&) under the shard lock, false if h is stale
+		template<class F>
+		bool visit(handle_type h, F&& f) const{
+			const size_type i = Layout::unpack_shard(h);
+			if(h == npos || i >= shards_.size()) return false;
+			std::lock_guard lock(shards_[i].mutex);
+			const value_type* p = shards_[i].tree.try_get(Layout::unpack_local(h));
+			if(!p) return false;
+			f(*p);
+			return true;
+		}
+
+		// f(tree_type&) with shard i locked, for batches. Keep to keys the shard owns,
+		// and note that handles from the tree are shard-local: Layout::pack(i, handle) makes them global
+		template<class F>
+		decltype(auto) with_shard(size_type i, F&& f){
+			std::lock_guard lock(shards_[i].mutex);
+			return f(shards_[i].tree);
+		}
+
+		// in order across all shards. Each shard is locked while it is visited, not the whole tree,
+		// so a concurrent writer may land before or after the visit of its shard
+		template<class F>
+		void for_each_inorder(F&& f) const{
+			for(const shard_& s : shards_){
+				std::lock_guard lock(s.mutex);
+				s.tree.for_each_inorder(f);
+			}
+		}
+
+		[[nodiscard]] size_type size() const{
+			size_type n = 0;
+			for(const shard_& s : shards_){
+				std::lock_guard lock(s.mutex);
+				n += s.tree.size();
+			}
+			return n;
+		}
+
+	private:
+		struct alignas(64) shard_ final{ // own cache line, so shard locks do not false-share
+			mutable std::mutex mutex;
+			tree_type tree;
+		};
+
+		std::vector<key_type> splits_;
+		std::vector<shard_> shards_;
+		[[no_unique_address]] Compare comp_;
+
+		template<class K>
+		static constexpr decltype(auto) key_of_(const K& probe) noexcept{
+			if constexpr(requires{ typename Policy::key_of; } && std::is_same_v<K, value_type>){
+				return std::invoke(typename Policy::key_of{}, probe);
+			} else{
+				return (probe);
+			}
+		}
+
+		template<class V>
+		std::pair<handle_type, bool> insert_(V&& v){
+			const size_type i = shard_of(std::as_const(v));
+			std::lock_guard lock(shards_[i].mutex);
+			const auto [local, inserted] = shards_[i].tree.insert(std::forward<V>(v));
+			return {Layout::pack(i, local), inserted};
+		}
+	};
+}
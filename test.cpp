@@ -1,6 +1,29 @@
 #include <gtest/gtest.h>
 
+#define FLAT_BST_PARALLEL
+
 #include "flat_bst.hpp" 
+#include "flat_btree.hpp"
+#include "flat_concurrent.hpp"
+#include "flat_map.hpp"
+#include "flat_mapped.hpp"
+#include "flat_sharded.hpp"
+#include <algorithm>
+#include <atomic>
+#include <execution>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <numeric>
+#include <set>
+#include <span>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 using flat::bst;
@@ -541,3 +564,1598 @@ TEST(FlatBst, EraseMissingKeyNoOp){
     EXPECT_EQ(t.size(), 3u);
     expect_equal_vec(inorder_dump(t), before);
 }
+
+// Test 27 - build layouts share the same shape but place slots differently
+TEST(FlatBst, BuildLayoutsSameShapeDifferentSlotOrder){
+    using L = flat::index_layout<uint32_t>;
+    std::vector<int> v;
+    for(int i = 1; i <= 15; ++i) v.push_back(i);
+
+    bst<int> pre, eyt, veb;
+    pre.build_from_sorted_unique(v.begin(), v.end());
+    eyt.build_from_sorted_unique(v.begin(), v.end(), flat::layout::eytzinger);
+    veb.build_from_sorted_unique(v.begin(), v.end(), flat::layout::veb);
+
+    expect_equal_vec(preorder_dump(eyt), preorder_dump(pre));
+    expect_equal_vec(preorder_dump(veb), preorder_dump(pre));
+    expect_equal_vec(inorder_dump(veb), v);
+
+    auto slot_order = [&](const bst<int>& t){
+        std::vector<int> by_slot(v.size());
+        for(int x : v) by_slot[L::unpack_index(t.find_handle(x))] = x;
+        return by_slot;
+    };
+    expect_equal_vec(slot_order(eyt), std::vector<int>({8, 4, 12, 2, 6, 10, 14, 1, 3, 5, 7, 9, 11, 13, 15}));
+    expect_equal_vec(slot_order(veb), std::vector<int>({8, 4, 12, 2, 1, 3, 6, 5, 7, 10, 9, 11, 14, 13, 15}));
+
+    // rebuild_balanced honours the layout too, on sizes that are not a full tree
+    bst<int> t;
+    for(int i = 1; i <= 100; ++i) (void)t.insert(i);
+    t.rebuild_balanced(flat::layout::veb);
+    EXPECT_EQ(t.size(), 100u);
+    expect_strictly_increasing(inorder_dump(t));
+    t.rebuild_balanced(flat::layout::eytzinger);
+    EXPECT_EQ(L::unpack_index(t.find_handle(51)), 0u);
+    for(int i = 1; i <= 100; ++i) EXPECT_TRUE(t.contains(i));
+}
+
+// Test 28 - frozen snapshot answers the same queries as the live tree
+TEST(FlatBst, FreezeMatchesLiveTree){
+    bst<int> t;
+    for(int i = 0; i < 200; i += 3) (void)t.insert(i);
+    (void)t.erase(99);
+
+    const auto f = t.freeze();
+    EXPECT_EQ(f.size(), t.size());
+
+    std::vector<int> via_frozen;
+    f.for_each_inorder([&](int v){ via_frozen.push_back(v); });
+    expect_equal_vec(via_frozen, inorder_dump(t));
+
+    for(int k = -2; k < 205; ++k){
+        EXPECT_EQ(f.contains(k), t.contains(k)) << k;
+        const int* lb = f.lower_bound(k);
+        const auto hlb = t.lower_bound_handle(k);
+        ASSERT_EQ(lb == nullptr, hlb == bst<int>::npos) << k;
+        if(lb){ EXPECT_EQ(*lb, t.at(hlb)); }
+        const int* ub = f.upper_bound(k);
+        const auto hub = t.upper_bound_handle(k);
+        ASSERT_EQ(ub == nullptr, hub == bst<int>::npos) << k;
+        if(ub){ EXPECT_EQ(*ub, t.at(hub)); }
+    }
+
+    // custom comparator, built straight from a sorted range
+    const std::vector<int> d = {9, 7, 5, 3, 1};
+    flat::frozen_bst<int, std::greater<int>> desc(d.begin(), d.end());
+    ASSERT_NE(desc.lower_bound(6), nullptr);
+    EXPECT_EQ(*desc.lower_bound(6), 5);
+    EXPECT_EQ(*desc.upper_bound(9), 7);
+    EXPECT_EQ(desc.upper_bound(1), nullptr);
+    EXPECT_TRUE(flat::frozen_bst<int>().empty());
+    EXPECT_EQ(flat::frozen_bst<int>().lower_bound(0), nullptr);
+}
+
+// Test 29 - btree (wide nodes) agrees with std::set under churn, handles survive splits and merges
+template <class Tree, class Compare, class MakeKey>
+static void btree_churn_check(MakeKey make_key){
+    using K = typename Tree::value_type;
+    Tree t;
+    std::set<K, Compare> ref;
+    std::map<K, typename Tree::handle_type, Compare> handles;
+    uint32_t rng = 12345;
+    auto next = [&]{ rng = rng * 1664525u + 1013904223u; return rng >> 8; };
+
+    for(int step = 0; step < 6000; ++step){
+        const K k = make_key(next() % 700);
+        if(next() % 3 != 0){
+            auto [h, ins] = t.insert(k);
+            ASSERT_EQ(ins, ref.insert(k).second);
+            if(ins) handles[k] = h;
+            EXPECT_EQ(h, handles[k]);
+        } else{
+            ASSERT_EQ(t.erase(k), ref.erase(k) == 1);
+            if(auto it = handles.find(k); it != handles.end()){
+                EXPECT_EQ(t.try_get(it->second), nullptr);
+                handles.erase(it);
+            }
+        }
+    }
+    ASSERT_EQ(t.size(), ref.size());
+    for(const auto& [k, h] : handles){
+        ASSERT_NE(t.try_get(h), nullptr);
+        EXPECT_EQ(t.at(h), k);
+    }
+    std::vector<K> dumped;
+    t.for_each_inorder([&](const K& v){ dumped.push_back(v); });
+    expect_equal_vec(dumped, std::vector<K>(ref.begin(), ref.end()));
+
+    for(uint32_t i = 0; i < 710; ++i){
+        const K k = make_key(i);
+        EXPECT_EQ(t.contains(k), ref.count(k) == 1);
+        const auto lb = t.lower_bound_handle(k);
+        const auto rlb = ref.lower_bound(k);
+        ASSERT_EQ(lb == Tree::npos, rlb == ref.end());
+        if(rlb != ref.end()){ EXPECT_EQ(t.at(lb), *rlb); }
+        const auto ub = t.upper_bound_handle(k);
+        const auto rub = ref.upper_bound(k);
+        ASSERT_EQ(ub == Tree::npos, rub == ref.end());
+        if(rub != ref.end()){ EXPECT_EQ(t.at(ub), *rub); }
+    }
+
+    for(const K& k : std::vector<K>(ref.begin(), ref.end())) ASSERT_TRUE(t.erase(k));
+    EXPECT_TRUE(t.empty());
+    EXPECT_EQ(t.height(), 0u);
+}
+
+TEST(FlatBtree, ChurnMatchesStdSet){
+    auto as_u32 = [](uint32_t i){ return i; };
+    btree_churn_check<flat::btree<uint32_t>, std::less<uint32_t>>(as_u32);
+    btree_churn_check<flat::btree<uint32_t, std::greater<uint32_t>>, std::greater<uint32_t>>(as_u32);
+    btree_churn_check<flat::btree<int32_t, std::less<int32_t>, uint32_t, 8>, std::less<int32_t>>([](uint32_t i){ return static_cast<int32_t>(i) - 350; });
+    btree_churn_check<flat::btree<float, std::less<float>, uint32_t, 3>, std::less<float>>([](uint32_t i){ return static_cast<float>(i) * 0.5f; });
+    btree_churn_check<flat::btree<std::string, std::less<std::string>, uint32_t, 4>, std::less<std::string>>([](uint32_t i){ return std::to_string(i); });
+}
+
+TEST(FlatBtree, WideNodesAreShallow){
+    flat::btree<uint32_t> t;
+    for(uint32_t i = 0; i < 4096; ++i) (void)t.insert(i); // sorted input
+    EXPECT_EQ(t.size(), 4096u);
+    EXPECT_LE(t.height(), 4u);
+    EXPECT_FALSE(t.insert(7u).second);
+    EXPECT_EQ(t.at(t.find_handle(4095u)), 4095u);
+    EXPECT_THROW((void)t.at(flat::btree<uint32_t>::npos), std::out_of_range);
+}
+
+struct ThrowingCopy{
+    int v = 0;
+    static inline bool armed = false;
+    ThrowingCopy() = default;
+    explicit ThrowingCopy(int x) : v(x){}
+    ThrowingCopy(const ThrowingCopy& o) : v(o.v){}
+    ThrowingCopy(ThrowingCopy&&) noexcept = default;
+    ThrowingCopy& operator=(const ThrowingCopy& o){ if(armed) throw std::runtime_error("copy"); v = o.v; return *this; }
+    ThrowingCopy& operator=(ThrowingCopy&&) noexcept = default;
+    bool operator<(const ThrowingCopy& o) const noexcept{ return v < o.v; }
+};
+
+TEST(FlatBtree, ThrowingInsertLeavesTreeIntact){
+    flat::btree<ThrowingCopy, std::less<ThrowingCopy>, uint32_t, 4> t;
+    for(int v = 0; v < 40; v += 2) t.insert(ThrowingCopy(v));
+    ThrowingCopy::armed = true;
+    const ThrowingCopy odd(7);
+    EXPECT_THROW(t.insert(odd), std::runtime_error);
+    ThrowingCopy::armed = false;
+    EXPECT_EQ(t.size(), 20u);
+    std::vector<int> seen;
+    t.for_each_inorder([&](const ThrowingCopy& k){ seen.push_back(k.v); });
+    EXPECT_EQ(seen.size(), 20u);
+    for(std::size_t i = 0; i < seen.size(); ++i) EXPECT_EQ(seen[i], static_cast<int>(2 * i));
+    const auto h = t.insert(odd).first; // the slot grabbed by the failed insert is reused
+    EXPECT_EQ(flat::index_layout<uint32_t>::unpack_index(h), 20u);
+    EXPECT_TRUE(t.erase(odd));
+    EXPECT_FALSE(t.erase(odd));
+    EXPECT_EQ(t.size(), 20u);
+}
+
+// Test 30 - AVL policy keeps sorted inserts balanced and handles stable across rotations
+using avl_bst = bst<int, std::less<int>, uint32_t, flat::avl_policy>;
+
+static std::vector<int> preorder_dump_avl(const avl_bst& t){
+    std::vector<int> out;
+    t.for_each_preorder([&](int v){ out.push_back(v); });
+    return out;
+}
+
+TEST(FlatBst, AvlPolicySortedInsertStaysBalanced){
+    avl_bst t;
+    std::vector<avl_bst::handle_type> handles;
+    for(int i = 1; i <= 15; ++i) handles.push_back(t.insert(i).first);
+
+    // sorted input into an AVL tree gives the perfect tree here
+    expect_equal_vec(preorder_dump_avl(t), std::vector<int>({8, 4, 2, 1, 3, 6, 5, 7, 12, 10, 9, 11, 14, 13, 15}));
+    for(int i = 1; i <= 15; ++i){
+        ASSERT_NE(t.try_get(handles[i - 1]), nullptr);
+        EXPECT_EQ(t.at(handles[i - 1]), i);
+    }
+
+    // erasing one side forces rotations on the way back up
+    for(int i = 1; i <= 7; ++i) EXPECT_TRUE(t.erase(i));
+    expect_equal_vec(preorder_dump_avl(t), std::vector<int>({12, 10, 8, 9, 11, 14, 13, 15}));
+    for(int i = 8; i <= 15; ++i) EXPECT_EQ(t.at(handles[i - 1]), i);
+}
+
+TEST(FlatBst, AvlPolicyChurnMatchesStdSet){
+    avl_bst t;
+    std::set<int> ref;
+    std::map<int, avl_bst::handle_type> handles;
+    uint32_t rng = 777;
+    auto next = [&]{ rng = rng * 1664525u + 1013904223u; return rng >> 8; };
+    for(int step = 0; step < 20000; ++step){
+        const int k = static_cast<int>(next() % 2000);
+        if(next() % 3 != 0){
+            auto [h, ins] = t.insert(k);
+            ASSERT_EQ(ins, ref.insert(k).second);
+            if(ins) handles[k] = h;
+        } else{
+            ASSERT_EQ(t.erase(k), ref.erase(k) == 1);
+            handles.erase(k);
+        }
+    }
+    EXPECT_EQ(t.size(), ref.size());
+    expect_equal_vec(inorder_dump_any(t), std::vector<int>(ref.begin(), ref.end()));
+    for(const auto& [k, h] : handles) EXPECT_EQ(t.at(h), k);
+
+    // balanced builds keep working under the policy and stay AVL-valid for later inserts
+    t.rebuild_balanced(flat::layout::eytzinger);
+    for(int i = 2000; i < 2100; ++i) (void)t.insert(i);
+    for(int i = 0; i < 2100; i += 2) (void)t.erase(i);
+    std::vector<int> expect;
+    for(int v : ref) if(v % 2) expect.push_back(v);
+    for(int i = 2001; i < 2100; i += 2) expect.push_back(i);
+    expect_equal_vec(inorder_dump_any(t), expect);
+}
+
+// Test 31 - rebalance_in_place keeps every handle and pointer, and yields the midpoint shape
+TEST(FlatBst, RebalanceInPlacePreservesHandles){
+    bst<int> t;
+    std::vector<bst<int>::handle_type> handles;
+    std::vector<const int*> ptrs;
+    t.reserve(15); // keep the pointers stable while filling
+    for(int i = 1; i <= 15; ++i){
+        handles.push_back(t.insert(i).first);
+        ptrs.push_back(t.try_get(handles.back()));
+    }
+    t.rebalance_in_place();
+
+    std::vector<int> sorted(15);
+    for(int i = 0; i < 15; ++i) sorted[i] = i + 1;
+    bst<int> ref;
+    ref.build_from_sorted_unique(sorted.begin(), sorted.end());
+    expect_equal_vec(preorder_dump(t), preorder_dump(ref));
+    for(int i = 0; i < 15; ++i){
+        EXPECT_EQ(t.try_get(handles[i]), ptrs[i]);
+        EXPECT_EQ(*ptrs[i], i + 1);
+    }
+}
+
+// Test 32 - scapegoat policy: sorted inserts and churn stay correct with stable handles
+TEST(FlatBst, ScapegoatPolicyChurnMatchesStdSet){
+    using sg_bst = bst<int, std::less<int>, uint32_t, flat::scapegoat_policy>;
+    sg_bst t;
+    std::map<int, sg_bst::handle_type> handles;
+    for(int i = 0; i < 5000; ++i) handles[i] = t.insert(i).first;
+    for(const auto& [k, h] : handles) ASSERT_EQ(t.at(h), k);
+
+    std::set<int> ref;
+    for(int i = 0; i < 5000; ++i) ref.insert(i);
+    uint32_t rng = 99;
+    auto next = [&]{ rng = rng * 1664525u + 1013904223u; return rng >> 8; };
+    for(int step = 0; step < 20000; ++step){
+        const int k = static_cast<int>(next() % 8000);
+        if(next() % 2){
+            auto [h, ins] = t.insert(k);
+            ASSERT_EQ(ins, ref.insert(k).second);
+            if(ins) handles[k] = h;
+        } else{
+            ASSERT_EQ(t.erase(k), ref.erase(k) == 1);
+            handles.erase(k);
+        }
+    }
+    EXPECT_EQ(t.size(), ref.size());
+    expect_equal_vec(inorder_dump_any(t), std::vector<int>(ref.begin(), ref.end()));
+    for(const auto& [k, h] : handles) EXPECT_EQ(t.at(h), k);
+}
+
+// Test 33 - iterator is bidirectional, allocation-free, and copes with degenerate depth
+TEST(FlatBst, BidirectionalIteratorForwardBackward){
+    static_assert(std::bidirectional_iterator<bst<int>::const_inorder_iterator>);
+    static_assert(std::is_trivially_copyable_v<bst<int>::const_inorder_iterator>);
+
+    bst<int> skewed; // sorted inserts: a 300-deep chain, far past the iterator's inline path
+    bst<int> zigzag; // alternating ends: deep, with turns in both directions
+    for(int i = 0; i < 300; ++i) (void)skewed.insert(i);
+    for(int i = 0; i < 150; ++i){
+        (void)zigzag.insert(i);
+        (void)zigzag.insert(299 - i);
+    }
+    for(const bst<int>* t : {&skewed, &zigzag}){
+        const auto fwd = inorder_dump(*t);
+        std::vector<int> via_iter(t->begin(), t->end());
+        expect_equal_vec(via_iter, fwd);
+
+        std::vector<int> rev(t->rbegin(), t->rend());
+        std::reverse(rev.begin(), rev.end());
+        expect_equal_vec(rev, fwd);
+
+        // walk forward halfway, then back to the start
+        auto it = t->begin();
+        for(int i = 0; i < 150; ++i) ++it;
+        EXPECT_EQ(*it, 150);
+        for(int i = 149; i >= 0; --i){
+            --it;
+            ASSERT_EQ(*it, i);
+        }
+        EXPECT_EQ(it, t->begin());
+        EXPECT_EQ(*std::prev(t->end()), 299);
+    }
+
+    bst<int> empty;
+    EXPECT_EQ(empty.begin(), empty.end());
+    EXPECT_EQ(empty.rbegin(), empty.rend());
+}
+
+// Test 34 - positioned bound iterators and range scans
+TEST(FlatBst, BoundIteratorsAndRangeScan){
+    bst<int> balanced;
+    bst<int> skewed;
+    std::set<int> ref;
+    for(int i = 0; i < 400; i += 4){
+        (void)skewed.insert(i); // 100-deep chain
+        ref.insert(i);
+    }
+    balanced.build_from_range(ref.begin(), ref.end());
+
+    for(const bst<int>* t : {&balanced, &skewed}){
+        for(int k = -3; k < 405; ++k){
+            auto lb = t->lower_bound(k);
+            auto rlb = ref.lower_bound(k);
+            ASSERT_EQ(lb == t->end(), rlb == ref.end()) << k;
+            if(rlb == ref.end()) continue;
+            EXPECT_EQ(*lb, *rlb);
+            EXPECT_EQ(lb.handle(), t->lower_bound_handle(k));
+            // the iterator continues in both directions from the bound
+            if(std::next(rlb) != ref.end()){ EXPECT_EQ(*std::next(lb), *std::next(rlb)); }
+            if(rlb != ref.begin()){ EXPECT_EQ(*std::prev(lb), *std::prev(rlb)); }
+
+            auto ub = t->upper_bound(k);
+            auto rub = ref.upper_bound(k);
+            ASSERT_EQ(ub == t->end(), rub == ref.end()) << k;
+            if(rub != ref.end()){ EXPECT_EQ(*ub, *rub); }
+        }
+
+        auto [a, b] = t->equal_range(8);
+        ASSERT_NE(a, t->end());
+        EXPECT_EQ(*a, 8);
+        EXPECT_EQ(*b, 12);
+        EXPECT_EQ(std::next(a), b);
+
+        std::vector<int> window;
+        t->for_each_in_range(10, 41, [&](int v){ window.push_back(v); });
+        expect_equal_vec(window, std::vector<int>({12, 16, 20, 24, 28, 32, 36, 40}));
+
+        window.clear();
+        t->for_each_in_range(397, 1000, [&](int v){ window.push_back(v); });
+        EXPECT_TRUE(window.empty());
+    }
+    const bst<int> empty;
+    EXPECT_EQ(empty.lower_bound(1), empty.end());
+}
+
+// Test 35 - transparent comparators allow lookups without building a temporary key
+struct CountingString final{
+    std::string s;
+    static inline int constructions = 0;
+    CountingString(std::string_view v) : s(v){ ++constructions; }
+};
+
+struct CountingStringLess final{
+    using is_transparent = void;
+    bool operator()(const CountingString& a, const CountingString& b) const noexcept{ return a.s < b.s; }
+    bool operator()(const CountingString& a, std::string_view b) const noexcept{ return a.s < b; }
+    bool operator()(std::string_view a, const CountingString& b) const noexcept{ return a < b.s; }
+};
+
+TEST(FlatBst, TransparentLookupBuildsNoTemporaries){
+    bst<CountingString, CountingStringLess> t;
+    for(std::string_view w : {"delta", "alpha", "echo", "charlie", "bravo"}) (void)t.emplace(w);
+
+    const int before = CountingString::constructions;
+    using namespace std::string_view_literals;
+    EXPECT_TRUE(t.contains("charlie"sv));
+    EXPECT_FALSE(t.contains("zulu"sv));
+    ASSERT_NE(t.find_ptr("echo"sv), nullptr);
+    EXPECT_EQ(t.find_ptr("echo"sv)->s, "echo");
+    EXPECT_EQ(t.at(t.find_handle("alpha"sv)).s, "alpha");
+    EXPECT_EQ(t.at(t.lower_bound_handle("b"sv)).s, "bravo");
+    EXPECT_EQ(t.at(t.upper_bound_handle("bravo"sv)).s, "charlie");
+    EXPECT_EQ(t.lower_bound("c"sv)->s, "charlie");
+    EXPECT_EQ(t.upper_bound("delta"sv)->s, "echo");
+    EXPECT_EQ(t.equal_range("delta"sv).first->s, "delta");
+    std::vector<std::string> window;
+    t.for_each_in_range("b"sv, "d"sv, [&](const CountingString& v){ window.push_back(v.s); });
+    expect_equal_vec(window, std::vector<std::string>({"bravo", "charlie"}));
+    EXPECT_TRUE(t.erase("bravo"sv));
+    EXPECT_FALSE(t.erase("bravo"sv));
+    EXPECT_EQ(CountingString::constructions, before);
+    EXPECT_EQ(t.size(), 4u);
+
+    // std::less<> works the same way for std::string keys, also on the frozen snapshot
+    bst<std::string, std::less<>> s{"b", "a", "c"};
+    EXPECT_TRUE(s.contains("a"sv));
+    EXPECT_TRUE(s.contains("c")); // const char[2]
+    const auto f = s.freeze();
+    EXPECT_TRUE(f.contains("b"sv));
+    EXPECT_EQ(*f.lower_bound("bb"sv), "c");
+}
+
+// Test 36 - batch lookups agree with one-at-a-time lookups
+TEST(FlatBst, BatchLookupMatchesSingleLookups){
+    bst<int> t;
+    uint32_t rng = 4242;
+    auto next = [&]{ rng = rng * 1664525u + 1013904223u; return rng >> 8; };
+    for(int i = 0; i < 3000; ++i) (void)t.insert(static_cast<int>(next() % 10000));
+
+    std::vector<int> keys;
+    for(int i = 0; i < 1000; ++i) keys.push_back(static_cast<int>(next() % 10000)); // not a multiple of the lane count
+    std::vector<bst<int>::handle_type> handles(keys.size());
+    std::unique_ptr<bool[]> found(new bool[keys.size()]);
+
+    const auto hits = t.find_handles(keys, handles);
+    EXPECT_EQ(t.contains_batch(keys, std::span<bool>(found.get(), keys.size())), hits);
+    size_t expect_hits = 0;
+    for(size_t i = 0; i < keys.size(); ++i){
+        EXPECT_EQ(handles[i], t.find_handle(keys[i])) << i;
+        EXPECT_EQ(found[i], t.contains(keys[i])) << i;
+        expect_hits += t.contains(keys[i]);
+    }
+    EXPECT_EQ(hits, expect_hits);
+
+    bst<int> empty;
+    EXPECT_EQ(empty.find_handles(keys, handles), 0u);
+    EXPECT_EQ(handles.front(), bst<int>::npos);
+}
+
+// Test 37 - sorted bulk insert links each gap's run as a balanced subtree and keeps handles
+TEST(FlatBst, InsertSortedRunsAndHandles){
+    bst<int> t;
+    const std::vector<int> first{1, 2, 3, 4, 5, 6, 7};
+    EXPECT_EQ(t.insert_sorted(first.begin(), first.end()), 7u);
+    expect_equal_vec(preorder_dump(t), std::vector<int>({4, 2, 1, 3, 6, 5, 7}));
+    const auto h4 = t.find_handle(4);
+    const auto h7 = t.find_handle(7);
+
+    // an appended batch hangs under the old maximum as one balanced subtree
+    const std::vector<int> tail{7, 8, 9, 10, 10, 11, 12, 13, 14};
+    EXPECT_EQ(t.insert_sorted(tail.begin(), tail.end()), 7u);
+    expect_equal_vec(preorder_dump(t), std::vector<int>({4, 2, 1, 3, 6, 5, 7, 11, 9, 8, 10, 13, 12, 14}));
+    EXPECT_EQ(*t.try_get(h4), 4);
+    EXPECT_EQ(*t.try_get(h7), 7);
+
+    // interleaved values fill several gaps, fronts and duplicates included
+    bst<int> m;
+    std::set<int> ref;
+    for(int v = 0; v < 400; v += 4){ m.insert(v); ref.insert(v); }
+    std::vector<bst<int>::handle_type> handles;
+    for(int v : ref) handles.push_back(m.find_handle(v));
+    std::vector<int> batch{-7, -3, -3};
+    for(int v = 1; v < 500; v += 3) batch.push_back(v);
+    const auto before = ref.size();
+    for(int v : batch) ref.insert(v);
+    EXPECT_EQ(m.insert_sorted(batch.begin(), batch.end()), ref.size() - before);
+    expect_equal_vec(inorder_dump(m), std::vector<int>(ref.begin(), ref.end()));
+    for(size_t i = 0; i < handles.size(); ++i) EXPECT_EQ(*m.try_get(handles[i]), static_cast<int>(i) * 4);
+
+    // self-balancing policies keep their shape guarantees
+    avl_bst a;
+    EXPECT_EQ(a.insert_sorted(batch.begin(), batch.end()), batch.size() - 1);
+    expect_strictly_increasing(inorder_dump_any(a));
+}
+
+// Test 38 - rebuild_compact packs live nodes and reports where every handle went
+TEST(FlatBst, RebuildCompactRemapsHandles){
+    bst<int> t;
+    std::map<int, bst<int>::handle_type> index;
+    for(int v = 0; v < 200; ++v) index[v] = t.insert(v).first;
+    for(int v = 0; v < 200; v += 3){ ASSERT_TRUE(t.erase(v)); index.erase(v); }
+    ASSERT_GT(t.capacity(), t.size());
+
+    const auto remap = t.rebuild_compact();
+    EXPECT_EQ(remap.size(), t.size());
+    EXPECT_EQ(t.capacity(), t.size());
+    expect_strictly_increasing(inorder_dump(t));
+    for(auto& [v, h] : index){
+        h = remap[h];
+        ASSERT_NE(h, bst<int>::npos) << v;
+        EXPECT_EQ(*t.try_get(h), v);
+    }
+    EXPECT_EQ(remap[bst<int>::npos], bst<int>::npos);
+    EXPECT_EQ(index.size(), t.size());
+
+    // callback form with a cache-friendly layout, on a move-only payload
+    bst<std::unique_ptr<int>, decltype([](const auto& a, const auto& b){ return *a < *b; })> p;
+    std::vector<std::pair<int, decltype(p)::handle_type>> owned;
+    for(int v : {5, 1, 9, 3, 7}) owned.emplace_back(v, p.insert(std::make_unique<int>(v)).first);
+    std::map<decltype(p)::handle_type, decltype(p)::handle_type> moved;
+    p.rebuild_compact([&](auto from, auto to){ moved[from] = to; }, flat::layout::eytzinger);
+    EXPECT_EQ(moved.size(), owned.size());
+    for(auto& [v, h] : owned){
+        h = moved.at(h);
+        EXPECT_EQ(**p.try_get(h), v);
+    }
+    EXPECT_EQ(**p.begin(), 1);
+}
+
+// Test 39 - slot storage and scratch buffers come from the policy allocator
+struct CountingResource : std::pmr::memory_resource{
+    size_t allocations = 0;
+    std::pmr::monotonic_buffer_resource arena;
+    void* do_allocate(size_t bytes, size_t align) override{ ++allocations; return arena.allocate(bytes, align); }
+    void do_deallocate(void*, size_t, size_t) override{}
+    bool do_is_equal(const std::pmr::memory_resource& o) const noexcept override{ return this == &o; }
+};
+
+TEST(FlatBst, PmrAllocatorCoversScratch){
+    CountingResource res;
+    flat::pmr::bst<int> t(&res);
+    for(int v : {5, 3, 8, 1, 4, 7, 9}) t.insert(v);
+    EXPECT_EQ(t.get_allocator().resource(), &res);
+    const auto after_insert = res.allocations;
+    EXPECT_GT(after_insert, 0u);
+
+    std::vector<int> seen;
+    t.for_each_postorder([&](int v){ seen.push_back(v); });
+    EXPECT_GT(res.allocations, after_insert); // traversal stacks
+    EXPECT_EQ(seen.size(), 7u);
+
+    const auto before_rebuild = res.allocations;
+    t.rebuild_balanced();
+    t.rebuild_compact();
+    EXPECT_GT(res.allocations, before_rebuild);
+    EXPECT_EQ(t.get_allocator().resource(), &res);
+    expect_equal_vec(inorder_dump_any(t), std::vector<int>({1, 3, 4, 5, 7, 8, 9}));
+    const auto before_callback = res.allocations;
+    t.rebuild_compact([](auto, auto){});
+    const auto callback_cost = res.allocations - before_callback;
+    const auto before_table = res.allocations;
+    const auto h = t.find_handle(4);
+    const auto remap = t.rebuild_compact();
+    EXPECT_GT(res.allocations - before_table, callback_cost); // the remap table as well
+    EXPECT_EQ(*t.try_get(remap[h]), 4);
+
+    // composes with the balancing policies
+    flat::pmr::bst<int, std::less<int>, uint32_t, flat::avl_policy> a({3, 1, 2}, {}, &res);
+    EXPECT_EQ(a.get_allocator().resource(), &res);
+    EXPECT_TRUE(a.contains(2));
+}
+
+// Test 40 - static_bst keeps everything inline and works in constant expressions
+constexpr int static_bst_sum(){
+    flat::static_bst<int, 32> t;
+    for(int v : {8, 3, 12, 1, 5, 10, 14}) t.insert(v);
+    t.erase(12);
+    t.insert(13);
+    t.rebuild_balanced(flat::layout::eytzinger);
+    int sum = 0;
+    t.for_each_postorder([&](int v){ sum += v; });
+    for(int v : t) sum += v;
+    return t.contains(13) && !t.contains(12) ? sum : -1;
+}
+static_assert(static_bst_sum() == 2 * (8 + 3 + 13 + 1 + 5 + 10 + 14));
+
+TEST(FlatBst, StaticBstInlineStorage){
+    using namespace std::literals;
+    static_assert(std::is_same_v<flat::static_bst<int, 50>::handle_type, uint8_t>);
+    static_assert(std::is_same_v<flat::static_bst<int, 256>::handle_type, uint16_t>);
+
+    flat::static_bst<std::string, 40, std::less<>, flat::avl_policy> t;
+    EXPECT_EQ(t.capacity(), 40u);
+    for(int i = 0; i < 40; ++i) t.insert(std::to_string(100 + i));
+    EXPECT_THROW(t.insert("999"), std::length_error);
+    EXPECT_EQ(t.size(), 40u);
+    const auto h = t.find_handle("120"sv);
+    EXPECT_TRUE(t.erase("105"sv));
+    EXPECT_TRUE(t.insert("999").second); // reuses the freed slot
+    EXPECT_EQ(*t.try_get(h), "120");
+    expect_strictly_increasing(inorder_dump_any(t));
+
+    const std::vector<std::string> mixed{"b", "a", "c", "a", "b"};
+    t.build_from_range(mixed.begin(), mixed.end());
+    expect_equal_vec(inorder_dump_any(t), std::vector<std::string>({"a", "b", "c"}));
+
+    // more values than slots is fine while the distinct ones fit, and each layout places them like the heap build
+    std::vector<std::string> repeated;
+    for(int i = 0; i < 120; ++i) repeated.push_back(std::to_string(100 + (i * 7) % 40));
+    for(auto order : {flat::layout::preorder, flat::layout::eytzinger, flat::layout::veb}){
+        t.build_from_range(repeated.begin(), repeated.end(), order);
+        EXPECT_EQ(t.size(), 40u);
+        bst<std::string, std::less<>, uint32_t, flat::avl_policy> heap;
+        heap.build_from_range(repeated.begin(), repeated.end(), order);
+        std::vector<std::string> inline_slots, heap_slots;
+        t.for_each_slot([&](const std::string& v){ inline_slots.push_back(v); });
+        heap.for_each_slot([&](const std::string& v){ heap_slots.push_back(v); });
+        expect_equal_vec(inline_slots, heap_slots);
+        expect_equal_vec(inorder_dump_any(t), inorder_dump_any(heap));
+        std::vector<std::string> inline_pre, heap_pre;
+        t.for_each_preorder([&](const std::string& v){ inline_pre.push_back(v); });
+        heap.for_each_preorder([&](const std::string& v){ heap_pre.push_back(v); });
+        expect_equal_vec(inline_pre, heap_pre); // the same links
+        EXPECT_TRUE(t.contains(std::string_view{"117"}));
+    }
+    repeated.push_back("999");
+    EXPECT_THROW(t.build_from_range(repeated.begin(), repeated.end()), std::length_error); // 41 distinct
+    EXPECT_EQ(t.size(), 40u);
+}
+
+// Test 41 - soa_policy keeps keys with the links and values in their own array
+struct Record{
+    int id;
+    std::string name;
+};
+
+TEST(FlatBst, SoaPolicyKeyedRecords){
+    using records = bst<Record, std::less<>, uint32_t, flat::soa_policy<flat::key_member<&Record::id>>>;
+    static_assert(std::is_same_v<records::key_type, int>);
+    records t;
+    for(int id : {50, 20, 80, 10, 30, 70, 90}) t.insert(Record{id, "r" + std::to_string(id)});
+    EXPECT_FALSE(t.insert(Record{20, "dup"}).second);
+    EXPECT_EQ(t.size(), 7u);
+
+    // bare keys through the transparent Compare, whole records through the projection
+    EXPECT_TRUE(t.contains(30));
+    EXPECT_TRUE(t.contains(Record{70, ""}));
+    EXPECT_FALSE(t.contains(40));
+    const auto h = t.find_handle(80);
+    EXPECT_EQ(t.at(h).name, "r80");
+    EXPECT_EQ(t.lower_bound(31)->id, 50);
+    EXPECT_EQ(t.upper_bound(50)->id, 70);
+
+    std::vector<int> window;
+    t.for_each_in_range(20, 71, [&](const Record& r){ window.push_back(r.id); });
+    expect_equal_vec(window, std::vector<int>({20, 30, 50, 70}));
+
+    EXPECT_TRUE(t.erase(50));
+    const auto h60 = t.insert(Record{60, "r60"}).first; // reuses the freed slot
+    EXPECT_EQ(t.find_handle(60), h60);
+    const std::vector<Record> more{{5, "r5"}, {65, "r65"}, {95, "r95"}};
+    EXPECT_EQ(t.insert_sorted(more.begin(), more.end()), 3u);
+    EXPECT_EQ(t.at(h).name, "r80");
+
+    const auto remap = t.rebuild_compact(flat::layout::veb);
+    EXPECT_EQ(t.at(remap[h]).name, "r80");
+    std::vector<int> ids;
+    for(const Record& r : t) ids.push_back(r.id);
+    expect_equal_vec(ids, std::vector<int>({5, 10, 20, 30, 60, 65, 70, 80, 90, 95}));
+
+    const std::vector<Record> raw{{3, "c"}, {1, "a"}, {2, "b"}, {1, "again"}};
+    t.build_from_range(raw.begin(), raw.end());
+    EXPECT_EQ(t.size(), 3u);
+    EXPECT_EQ(t.begin()->id, 1);
+}
+
+// Test 42 - flat::map builds a mapped value only on a real insert
+struct CountedValue{
+    static inline int constructions = 0;
+    int v = 0;
+    CountedValue(){ ++constructions; }
+    explicit CountedValue(int x) : v(x){ ++constructions; }
+    CountedValue(const CountedValue& o) : v(o.v){ ++constructions; }
+    CountedValue(CountedValue&& o) noexcept : v(o.v){}
+    CountedValue& operator=(const CountedValue&) = default;
+    CountedValue& operator=(CountedValue&&) noexcept = default;
+};
+
+TEST(FlatBst, MapTryEmplaceAndAccess){
+    flat::map<int, CountedValue> m;
+    CountedValue::constructions = 0;
+    EXPECT_TRUE(m.try_emplace(2, 20).second);
+    EXPECT_TRUE(m.try_emplace(1, 10).second);
+    EXPECT_EQ(CountedValue::constructions, 2);
+    const auto h = m.try_emplace(2, 99).first;
+    EXPECT_FALSE(m.try_emplace(2, 99).second);
+    EXPECT_EQ(CountedValue::constructions, 2); // duplicates build nothing
+    EXPECT_EQ(m.at(2).v, 20);
+
+    m[3].v = 30; // value-initialized once, then assigned through the reference
+    m[3].v += 1;
+    EXPECT_EQ(CountedValue::constructions, 3);
+    EXPECT_FALSE(m.insert_or_assign(2, CountedValue(21)).second);
+    EXPECT_TRUE(m.insert_or_assign(4, CountedValue(40)).second);
+    EXPECT_EQ(m.try_get(h)->second.v, 21);
+    static_assert(std::is_const_v<std::remove_reference_t<decltype(m.try_get(h)->first)>>); // keys stay put
+    EXPECT_EQ(m.find_ptr(3)->v, 31);
+    EXPECT_EQ(m.find_ptr(7), nullptr);
+    EXPECT_THROW((void) m.at(7), std::out_of_range);
+
+    std::vector<int> keys;
+    for(const auto& [k, val] : m) keys.push_back(k);
+    expect_equal_vec(keys, std::vector<int>({1, 2, 3, 4}));
+    EXPECT_TRUE(m.erase(1));
+    EXPECT_FALSE(m.contains(1));
+    EXPECT_EQ(m.lower_bound(2)->first, 2);
+    EXPECT_EQ(m.upper_bound(3)->first, 4);
+    EXPECT_EQ(m.size(), 3u);
+
+    // string keys looked up by string_view, AVL underneath
+    using namespace std::literals;
+    flat::map<std::string, int, std::less<>, uint32_t, flat::avl_policy> words{{"b", 2}, {"a", 1}};
+    words["c"] = 3;
+    EXPECT_EQ(words.at("b"sv), 2);
+    EXPECT_TRUE(words.contains("c"sv));
+    EXPECT_TRUE(words.erase("a"sv));
+    EXPECT_EQ(words.begin()->first, "b");
+
+    // each entry is one pair<const Key, T>: duplicates in the initializer drop, compaction moves whole pairs
+    flat::map<std::string, int, std::less<>, uint32_t, flat::maintenance_policy<flat::maintenance_defaults, flat::avl_policy>> sparse{{"x", 1}, {"y", 2}, {"x", 3}};
+    EXPECT_EQ(sparse.size(), 2u);
+    EXPECT_EQ(sparse.at("x"sv), 1);
+    for(int i = 0; i < 100; ++i) sparse[std::to_string(i)] = i;
+    for(int i = 0; i < 100; ++i) EXPECT_TRUE(sparse.erase(std::to_string(i)));
+    EXPECT_EQ(sparse.maintain(), flat::maintenance_reason::fragmented);
+    EXPECT_EQ(sparse.capacity(), 2u);
+    EXPECT_EQ(sparse.begin()->first, "x");
+    EXPECT_EQ(sparse.at("y"sv), 2);
+}
+
+// Test 43 - emplace builds in place, hinted appends hang off the current maximum
+struct EmplaceOnly{
+    static inline int moves = 0;
+    int key;
+    std::string tag;
+    EmplaceOnly(int k, std::string t) : key(k), tag(std::move(t)){}
+    EmplaceOnly(const EmplaceOnly&) = delete;
+    EmplaceOnly(EmplaceOnly&& o) noexcept : key(o.key), tag(std::move(o.tag)){ ++moves; }
+    EmplaceOnly& operator=(EmplaceOnly&&) noexcept = default;
+    bool operator<(const EmplaceOnly& o) const noexcept{ return key < o.key; }
+};
+
+TEST(FlatBst, EmplaceInPlaceAndHints){
+    bst<EmplaceOnly> t;
+    t.reserve(8);
+    EmplaceOnly::moves = 0;
+    EXPECT_TRUE(t.emplace(2, "two").second);
+    EXPECT_TRUE(t.emplace(1, "one").second);
+    const auto dup = t.emplace(2, "again");
+    EXPECT_FALSE(dup.second);
+    EXPECT_EQ(t.at(dup.first).tag, "two");
+    EXPECT_EQ(EmplaceOnly::moves, 0);
+    EXPECT_EQ(t.size(), 2u);
+    EXPECT_TRUE(t.emplace(3, "three").second); // reuses the slot freed by the duplicate
+    EXPECT_EQ(t.capacity(), 8u);
+
+    // appends through the previous handle, including stale and wrong hints
+    bst<int> a;
+    auto h = bst<int>::npos;
+    for(int v = 0; v < 1000; ++v) h = a.insert(h, v).first;
+    EXPECT_EQ(*a.try_get(h), 999);
+    EXPECT_FALSE(a.insert(h, 500).second);      // not after the hint: plain insert finds it
+    EXPECT_TRUE(a.insert(a.find_handle(10), 1500).second); // hint isn't the max: still lands right
+    EXPECT_TRUE(a.erase(1500));
+    EXPECT_TRUE(a.erase(999));
+    EXPECT_TRUE(a.insert(h, 2000).second);         // stale hint
+    h = a.emplace_hint(a.find_handle(2000), 2001).first;
+    EXPECT_EQ(*a.try_get(h), 2001);
+    expect_strictly_increasing(inorder_dump(a));
+    EXPECT_EQ(a.size(), 1001u);
+
+    avl_bst b;
+    auto hb = avl_bst::npos;
+    for(int v = 0; v < 100; ++v) hb = b.insert(hb, v).first;
+    EXPECT_EQ(*b.try_get(hb), 99);
+    expect_strictly_increasing(inorder_dump_any(b));
+}
+
+// Test 44 - order statistics: nth, rank and count agree with a std::set through inserts, erases and rebuilds
+template <class Tree>
+static void expect_order_statistics(const Tree& t, const std::set<int>& ref){
+    ASSERT_EQ(t.size(), ref.size());
+    std::size_t k = 0;
+    for(int v : ref){
+        auto it = t.nth(k);
+        ASSERT_NE(it, t.end());
+        EXPECT_EQ(*it, v);
+        EXPECT_EQ(t.rank(v), k);
+        ++k;
+    }
+    EXPECT_EQ(t.nth(ref.size()), t.end());
+    for(int lo = -5; lo < 260; lo += 37){
+        for(int hi = lo; hi < 270; hi += 23){
+            const auto expected = static_cast<std::size_t>(std::distance(ref.lower_bound(lo), ref.lower_bound(hi)));
+            EXPECT_EQ(t.count(lo, hi), expected);
+        }
+    }
+    EXPECT_EQ(t.count(10, 5), 0u);
+}
+
+template <class Tree>
+static void run_order_statistics(){
+    Tree t;
+    std::set<int> ref;
+    unsigned x = 12345;
+    for(int i = 0; i < 400; ++i){
+        x = x * 1103515245u + 12345u;
+        const int v = static_cast<int>((x >> 8) % 256);
+        if((x >> 20) % 3 == 0){
+            EXPECT_EQ(t.erase(v), ref.erase(v) == 1);
+        } else{
+            EXPECT_EQ(t.insert(v).second, ref.insert(v).second);
+        }
+    }
+    expect_order_statistics(t, ref);
+
+    t.rebuild_balanced();
+    expect_order_statistics(t, ref);
+    t.rebuild_compact(flat::layout::eytzinger);
+    expect_order_statistics(t, ref);
+
+    std::vector<int> sorted(ref.begin(), ref.end());
+    Tree built;
+    built.build_from_sorted_unique(sorted.begin(), sorted.end());
+    expect_order_statistics(built, ref);
+    built.insert(1000);
+    ref.insert(1000);
+    expect_order_statistics(built, ref);
+}
+
+TEST(FlatBst, OrderStatistics){
+    run_order_statistics<bst<int, std::less<int>, uint32_t, flat::order_statistics_policy<>>>();
+    run_order_statistics<bst<int, std::less<int>, uint32_t, flat::order_statistics_policy<flat::scapegoat_policy>>>();
+}
+
+// Test 45 - aggregates: ordered range folds, pruned interval-overlap visits and refresh after in-place edits
+struct OrderedHash{ // polynomial hash, so any out-of-order combine shows up
+    struct value_type{ std::uint64_t h; std::uint64_t p; bool operator==(const value_type&) const = default; };
+    static constexpr value_type identity() noexcept{ return {0, 1}; }
+    static constexpr value_type lift(int v) noexcept{ return {static_cast<std::uint64_t>(v) + 1, 1000003}; }
+    static constexpr value_type combine(value_type a, value_type b) noexcept{ return {a.h * b.p + b.h, a.p * b.p}; }
+};
+
+template <class Tree>
+static void expect_range_hashes(const Tree& t, const std::set<int>& ref){
+    for(int lo = -3; lo < 260; lo += 29){
+        for(int hi = lo; hi < 265; hi += 17){
+            auto expected = OrderedHash::identity();
+            for(auto it = ref.lower_bound(lo); it != ref.end() && *it < hi; ++it) expected = OrderedHash::combine(expected, OrderedHash::lift(*it));
+            EXPECT_EQ(t.aggregate(lo, hi), expected);
+        }
+    }
+    auto all = OrderedHash::identity();
+    for(int v : ref) all = OrderedHash::combine(all, OrderedHash::lift(v));
+    EXPECT_EQ(t.aggregate(), all);
+}
+
+template <class Tree>
+static void run_range_hashes(){
+    Tree t;
+    std::set<int> ref;
+    unsigned x = 777;
+    for(int i = 0; i < 400; ++i){
+        x = x * 1103515245u + 12345u;
+        const int v = static_cast<int>((x >> 8) % 256);
+        if((x >> 20) % 3 == 0){
+            EXPECT_EQ(t.erase(v), ref.erase(v) == 1);
+        } else{
+            EXPECT_EQ(t.insert(v).second, ref.insert(v).second);
+        }
+    }
+    expect_range_hashes(t, ref);
+    t.rebuild_compact(flat::layout::veb);
+    expect_range_hashes(t, ref);
+    std::vector<int> sorted(ref.begin(), ref.end());
+    Tree built;
+    built.build_from_sorted_unique(sorted.begin(), sorted.end(), flat::layout::eytzinger);
+    expect_range_hashes(built, ref);
+}
+
+struct Interval{
+    int start;
+    int end;
+};
+
+struct MaxEnd{
+    using value_type = int;
+    static constexpr int identity() noexcept{ return std::numeric_limits<int>::min(); }
+    static constexpr int lift(const Interval& v) noexcept{ return v.end; }
+    static constexpr int combine(int a, int b) noexcept{ return std::max(a, b); }
+};
+
+struct SumMapped{
+    using value_type = long long;
+    static constexpr long long identity() noexcept{ return 0; }
+    static constexpr long long lift(const std::pair<const int, int>& kv) noexcept{ return kv.second; }
+    static constexpr long long combine(long long a, long long b) noexcept{ return a + b; }
+};
+
+TEST(FlatBst, AggregatesAndPrunedOverlap){
+    run_range_hashes<bst<int, std::less<int>, uint32_t, flat::augment_policy<OrderedHash>>>();
+    run_range_hashes<bst<int, std::less<int>, uint32_t, flat::augment_policy<OrderedHash, flat::scapegoat_policy>>>();
+    run_range_hashes<bst<int, std::less<int>, uint32_t, flat::order_statistics_policy<flat::augment_policy<OrderedHash>>>>();
+
+    using interval_tree = bst<Interval, std::less<>, uint32_t, flat::soa_policy<flat::key_member<&Interval::start>, flat::augment_policy<MaxEnd>>>;
+    interval_tree t;
+    std::vector<Interval> ref;
+    for(int s = 0; s < 300; s += 3){
+        const Interval iv{s, s + 1 + (s * 7) % 40};
+        t.insert(iv);
+        ref.push_back(iv);
+    }
+    auto overlapping = [&](int lo, int hi){
+        std::vector<int> got;
+        t.for_each_pruned(hi, [&](int max_end){ return max_end > lo; }, [&](const Interval& iv){ got.push_back(iv.start); });
+        return got;
+    };
+    auto brute = [&](int lo, int hi){
+        std::vector<int> want;
+        for(const Interval& iv : ref) if(iv.start < hi && iv.end > lo) want.push_back(iv.start);
+        return want;
+    };
+    for(int lo = 0; lo < 320; lo += 13) EXPECT_EQ(overlapping(lo, lo + 5), brute(lo, lo + 5));
+
+    // widen one interval in place, then repair the aggregates above it
+    const auto h = t.find_handle(150);
+    ASSERT_NE(h, interval_tree::npos);
+    t.try_get(h)->end = 1000;
+    EXPECT_TRUE(t.refresh(h));
+    ref[50].end = 1000;
+    EXPECT_EQ(t.aggregate(), 1000);
+    EXPECT_EQ(overlapping(500, 510), brute(500, 510));
+    EXPECT_EQ(overlapping(500, 510), std::vector<int>{150});
+
+    flat::map<int, int, std::less<int>, uint32_t, flat::augment_policy<SumMapped>> m;
+    for(int k = 0; k < 50; ++k) m[k] = k;
+    EXPECT_EQ(m.aggregate(10, 20), 145);
+    *m.find_ptr(15) = 100;
+    EXPECT_TRUE(m.refresh(m.find_handle(15)));
+    EXPECT_EQ(m.aggregate(10, 20), 230);
+}
+
+// Test 46 - parallel builds lay out the same tree as the serial ones
+template <class Tree>
+static std::vector<typename Tree::handle_type> handles_inorder(const Tree& t){
+    std::vector<typename Tree::handle_type> out;
+    for(auto v : inorder_dump_any(t)) out.push_back(t.find_handle(v));
+    return out;
+}
+
+TEST(FlatBst, ParallelBuildsMatchSerial){
+    std::vector<int> input;
+    unsigned x = 99;
+    for(int i = 0; i < 20000; ++i){
+        x = x * 1103515245u + 12345u;
+        input.push_back(static_cast<int>((x >> 8) % 15000));
+    }
+
+    bst<int> serial, parallel;
+    serial.build_from_range(input.begin(), input.end());
+    parallel.build_from_range(std::execution::par, input.begin(), input.end());
+    EXPECT_EQ(preorder_dump(parallel), preorder_dump(serial));
+    EXPECT_EQ(handles_inorder(parallel), handles_inorder(serial));
+    EXPECT_EQ(parallel.size(), serial.size());
+
+    // AVL heights and order-statistics sizes come out of the fill directly
+    using os_bst = bst<int, std::less<int>, uint32_t, flat::order_statistics_policy<>>;
+    os_bst os;
+    os.build_from_range(std::execution::par, input.begin(), input.end());
+    const auto sorted = inorder_dump_any(serial);
+    for(std::size_t k = 0; k < sorted.size(); k += 97) EXPECT_EQ(*os.nth(k), sorted[k]);
+    for(int v = 15000; v < 15100; ++v) os.insert(v);
+    EXPECT_EQ(os.rank(15050), sorted.size() + 50);
+    expect_strictly_increasing(inorder_dump_any(os));
+
+    // rebuild a skewed tree, and a build under soa_policy
+    bst<int> skewed;
+    for(int v = 0; v < 3000; ++v) skewed.insert(v);
+    skewed.rebuild_balanced(std::execution::par);
+    bst<int> reference;
+    for(int v = 0; v < 3000; ++v) reference.insert(v);
+    reference.rebuild_balanced();
+    EXPECT_EQ(preorder_dump(skewed), preorder_dump(reference));
+
+    using record_bst = bst<Record, std::less<>, uint32_t, flat::soa_policy<flat::key_member<&Record::id>>>;
+    std::vector<Record> records;
+    for(int i = 0; i < 500; ++i) records.push_back(Record{(i * 37) % 500, "r" + std::to_string(i)});
+    record_bst rs;
+    rs.build_from_range(std::execution::par, records.begin(), records.end(), flat::layout::eytzinger);
+    EXPECT_EQ(rs.size(), 500u);
+    for(int id = 0; id < 500; ++id){
+        auto p = rs.try_get(rs.find_handle(id));
+        ASSERT_NE(p, nullptr);
+        EXPECT_EQ(p->id, id);
+    }
+    parallel.build_from_sorted_unique(std::execution::par, sorted.begin(), sorted.begin());
+    EXPECT_TRUE(parallel.empty());
+}
+
+// Test 47 - unordered slot scans: for_each_slot, parallel_for_each and parallel_reduce skip the holes
+TEST(FlatBst, SlotScansAndParallelReduce){
+    bst<int> t;
+    std::set<int> ref;
+    for(int v = 0; v < 5000; ++v){ t.insert((v * 7919) % 5000); ref.insert(v); }
+    for(int v = 0; v < 5000; v += 3){ t.erase(v); ref.erase(v); }
+
+    std::vector<int> seen;
+    t.for_each_slot([&](int v){ seen.push_back(v); });
+    std::sort(seen.begin(), seen.end());
+    EXPECT_EQ(seen, std::vector<int>(ref.begin(), ref.end()));
+
+    long long expected = 0;
+    for(int v : ref) expected += v;
+    EXPECT_EQ(t.parallel_reduce(std::execution::par, 0LL, std::plus<>{}, [](int v){ return static_cast<long long>(v); }), expected);
+
+    std::atomic<long long> sum{0};
+    std::atomic<std::size_t> visits{0};
+    t.parallel_for_each(std::execution::par, [&](int v){ sum += v; ++visits; });
+    EXPECT_EQ(sum.load(), expected);
+    EXPECT_EQ(visits.load(), ref.size());
+
+    flat::static_bst<int, 16> small;
+    for(int v : {5, 1, 9}) small.insert(v);
+    small.erase(1);
+    EXPECT_EQ(small.parallel_reduce(std::execution::seq, 0, std::plus<>{}, [](int v){ return v; }), 14);
+}
+
+// Test 48 - concurrent_bst: readers only ever see whole published batches, retired snapshots get freed
+TEST(FlatBst, ConcurrentSnapshotsPublishWholeBatches){
+    flat::concurrent_bst<int> tree(8);
+    constexpr int batches = 200, batch = 50;
+    std::atomic<bool> done{false};
+    std::atomic<int> torn{0};
+
+    std::vector<std::thread> readers;
+    for(int r = 0; r < 4; ++r){
+        readers.emplace_back([&]{
+            const auto id = tree.register_reader();
+            std::size_t last = 0;
+            while(!done.load()){
+                auto snap = tree.read(id);
+                const std::size_t n = snap->size();
+                // batches insert 0, 1, 2, ... so a snapshot holds exactly [0, n), n a multiple of batch
+                if(n % batch != 0 || n < last) ++torn;
+                if(n && (!snap->contains(static_cast<int>(n) - 1) || snap->contains(static_cast<int>(n)))) ++torn;
+                last = n;
+            }
+            tree.unregister_reader(id);
+            });
+    }
+    int next = 0;
+    for(int b = 0; b < batches; ++b){
+        for(int i = 0; i < batch; ++i) tree.edit().insert(next++);
+        tree.publish();
+    }
+    done = true;
+    for(auto& t : readers) t.join();
+    EXPECT_EQ(torn.load(), 0);
+
+    tree.publish(); // no reader is pinned, so everything retired so far is freed
+    EXPECT_EQ(tree.retired_count(), 0u);
+    const auto id = tree.register_reader();
+    {
+        auto snap = tree.read(id);
+        EXPECT_EQ(snap->size(), static_cast<std::size_t>(batches * batch));
+        const auto h = snap->find_handle(123);
+        tree.edit().erase(124);
+        tree.publish();
+        EXPECT_EQ(tree.retired_count(), 1u); // still pinned by snap
+        EXPECT_TRUE(tree.working().is_handle_valid(h)); // snapshot handles carry over
+        EXPECT_TRUE(snap->contains(124));
+    }
+    EXPECT_FALSE(tree.read(id)->contains(124));
+    tree.unregister_reader(id);
+}
+
+// Test 49 - sharded_bst: concurrent inserts per range, handles route to their shard, ordered visits span shards
+TEST(FlatBst, ShardedRoutesHandlesAndKeepsOrder){
+    flat::sharded_bst<int> t({1000, 2000, 3000});
+    EXPECT_EQ(t.shard_count(), 4u);
+    EXPECT_EQ(t.shard_of(-5), 0u);
+    EXPECT_EQ(t.shard_of(1000), 1u);
+    EXPECT_EQ(t.shard_of(3999), 3u);
+
+    std::vector<std::thread> writers;
+    for(int w = 0; w < 4; ++w){
+        writers.emplace_back([&, w]{
+            for(int v = w; v < 4000; v += 4) t.insert(v);
+            });
+    }
+    for(auto& th : writers) th.join();
+    EXPECT_EQ(t.size(), 4000u);
+
+    std::vector<int> all;
+    t.for_each_inorder([&](int v){ all.push_back(v); });
+    std::vector<int> expected(4000);
+    std::iota(expected.begin(), expected.end(), 0);
+    EXPECT_EQ(all, expected);
+
+    const auto h = t.find_handle(2500);
+    EXPECT_EQ(t.shard_of_handle(h), 2u);
+    EXPECT_EQ(t.at(h), 2500);
+    const auto again = t.insert(2500);
+    EXPECT_FALSE(again.second);
+    EXPECT_EQ(again.first, h);
+
+    EXPECT_TRUE(t.erase(2500));
+    EXPECT_FALSE(t.contains(2500));
+    EXPECT_FALSE(t.try_get(h).has_value());
+    EXPECT_THROW((void)t.at(h), std::out_of_range);
+    EXPECT_EQ(t.find_handle(2500), decltype(t)::npos);
+    EXPECT_FALSE(t.visit(decltype(t)::npos, [](int){}));
+
+    const auto n = t.with_shard(0, [](auto& shard){ return shard.size(); });
+    EXPECT_EQ(n, 1000u);
+}
+
+// Test 50 - save() and mapped_bst: lookups, bounds, ranges and old handles straight from the file
+TEST(FlatBst, SaveAndMapReadOnly){
+    avl_bst t;
+    std::vector<avl_bst::handle_type> handles;
+    for(int v = 0; v < 3000; ++v) handles.push_back(t.insert(v * 2).first);
+    for(int v = 0; v < 3000; v += 5) t.erase(v * 2);
+
+    const auto path = (std::filesystem::temp_directory_path() / "flat_bst_test_50.bin").string();
+    {
+        std::ofstream out(path, std::ios::binary);
+        t.save(out);
+        ASSERT_TRUE(out.good());
+    }
+    {
+        auto m = flat::mapped_bst<int>::open(path);
+        EXPECT_EQ(m.size(), t.size());
+        std::vector<int> seen;
+        m.for_each_inorder([&](int v){ seen.push_back(v); });
+        EXPECT_EQ(seen, inorder_dump_any(t));
+        EXPECT_TRUE(m.contains(2));
+        EXPECT_FALSE(m.contains(0)); // erased
+        EXPECT_FALSE(m.contains(3));
+        EXPECT_EQ(*m.lower_bound(3), 4);
+        EXPECT_EQ(*m.upper_bound(4), 6);
+        EXPECT_EQ(m.upper_bound(6000), nullptr);
+        std::vector<int> range;
+        m.for_each_in_range(9, 21, [&](int v){ range.push_back(v); });
+        EXPECT_EQ(range, (std::vector<int>{12, 14, 16, 18}));
+        for(std::size_t i = 0; i < handles.size(); ++i){
+            const int* p = m.try_get(handles[i]);
+            if(i % 5 == 0){ EXPECT_EQ(p, nullptr); } else{ ASSERT_NE(p, nullptr); EXPECT_EQ(*p, static_cast<int>(i) * 2); }
+        }
+        auto moved = std::move(m);
+        EXPECT_TRUE(moved.contains(4));
+    }
+
+    std::ostringstream buf;
+    t.save(buf);
+    std::string bytes = buf.str();
+    std::vector<std::byte> copy(bytes.size());
+    std::memcpy(copy.data(), bytes.data(), bytes.size());
+    EXPECT_EQ(flat::mapped_bst<int>(copy).size(), t.size());
+    EXPECT_THROW((flat::mapped_bst<long long>(copy)), std::runtime_error); // wrong value type
+    copy.back() ^= std::byte{1};
+    EXPECT_THROW((flat::mapped_bst<int>(copy)), std::runtime_error); // checksum
+    EXPECT_NO_THROW((flat::mapped_bst<int>(copy, flat::mapped_bst<int>::check::header)));
+    copy.resize(copy.size() - 1);
+    EXPECT_THROW((flat::mapped_bst<int>(copy, flat::mapped_bst<int>::check::header)), std::runtime_error); // truncated
+    std::filesystem::remove(path);
+}
+
+// Test 51 - stats() reports shape, free list and locality; counting_policy counts probes
+TEST(FlatBst, StatsAndProbeCounts){
+    bst<int> empty;
+    const auto none = empty.stats();
+    EXPECT_EQ(none.height, 0u);
+    EXPECT_EQ(none.fill_ratio, 1.0);
+
+    bst<int> chain;
+    for(int v = 0; v < 64; ++v) chain.insert(v);
+    for(int v = 0; v < 16; ++v) chain.erase(v);
+    auto st = chain.stats();
+    EXPECT_EQ(st.size, 48u);
+    EXPECT_EQ(st.slots, 64u);
+    EXPECT_EQ(st.free_slots, 16u);
+    EXPECT_DOUBLE_EQ(st.fill_ratio, 0.75);
+    EXPECT_EQ(st.height, 48u); // sorted inserts: a right spine
+    EXPECT_DOUBLE_EQ(st.average_depth, 24.5);
+    EXPECT_EQ(st.depth_histogram, std::vector<std::size_t>(48, 1));
+    EXPECT_DOUBLE_EQ(st.average_link_distance, 1.0);
+
+    chain.rebuild_balanced();
+    st = chain.stats();
+    EXPECT_EQ(st.height, 6u);
+    EXPECT_EQ(st.free_slots, 0u);
+    EXPECT_EQ(st.depth_histogram[0], 1u);
+    EXPECT_EQ(std::accumulate(st.depth_histogram.begin(), st.depth_histogram.end(), std::size_t{0}), 48u);
+    EXPECT_LT(st.average_depth, 6.0);
+
+    using counted = bst<int, std::less<int>, uint32_t, flat::counting_policy<>>;
+    counted c;
+    for(int v : {4, 2, 6, 1, 3, 5, 7}) c.insert(v);
+    c.reset_probe_counts();
+    EXPECT_TRUE(c.contains(4)); // root hit: one node, two comparisons
+    auto pc = c.probe_counts();
+    EXPECT_EQ(pc.searches, 1u);
+    EXPECT_EQ(pc.nodes_visited, 1u);
+    EXPECT_EQ(pc.comparisons, 2u);
+    EXPECT_FALSE(c.contains(0)); // 4, 2, 1 all to the left
+    pc = c.probe_counts();
+    EXPECT_EQ(pc.searches, 2u);
+    EXPECT_EQ(pc.nodes_visited, 4u);
+    EXPECT_EQ(pc.comparisons, 5u);
+    EXPECT_TRUE(c.erase(4)); // search hits the root, then walks to the successor 5
+    pc = c.probe_counts();
+    EXPECT_EQ(pc.searches, 3u);
+    EXPECT_EQ(pc.nodes_visited, 7u);
+    static_assert(sizeof(counted) > sizeof(bst<int>));
+}
+
+struct EagerMaintenance : flat::maintenance_defaults{
+    static constexpr std::size_t min_size = 16;
+    static constexpr flat::maintenance_mode mode = flat::maintenance_mode::rebuild;
+};
+struct NotifyMaintenance : EagerMaintenance{
+    static constexpr flat::maintenance_mode mode = flat::maintenance_mode::notify;
+};
+struct AmortizedMaintenance : flat::maintenance_defaults{
+    static constexpr flat::maintenance_mode mode = flat::maintenance_mode::amortized;
+};
+static_assert(flat::maintenance_defaults::mode == flat::maintenance_mode::notify); // nothing runs on the hot path unasked
+
+// Test 52 - maintenance_policy relinks trees that grow too deep, or only reports; holey ones are reported, never compacted unasked
+TEST(FlatBst, MaintenancePolicyTriggers){
+    using amortized = bst<int, std::less<int>, uint32_t, flat::maintenance_policy<AmortizedMaintenance>>;
+    amortized a;
+    const auto first = a.insert(0).first;
+    for(int v = 1; v < 4096; ++v) a.insert(v); // sorted: a spine without maintenance
+    EXPECT_LE(a.stats().height, 2u * std::bit_width(4096u));
+    EXPECT_EQ(a.size(), 4096u);
+    ASSERT_NE(a.try_get(first), nullptr); // depth repairs only relink
+    EXPECT_EQ(*a.try_get(first), 0);
+    EXPECT_TRUE(std::is_sorted(a.begin(), a.end()));
+    EXPECT_EQ(a.maintenance_due(), flat::maintenance_reason::none);
+
+    bst<int, std::less<int>, uint32_t, flat::maintenance_policy<EagerMaintenance>> e;
+    for(int v = 0; v < 1000; ++v) e.insert(v);
+    EXPECT_LE(e.stats().height, 2u * std::bit_width(1000u));
+    auto h999 = e.find_handle(999);
+    std::vector<flat::maintenance_reason> e_calls;
+    e.on_maintenance_due([&](flat::maintenance_reason r){ e_calls.push_back(r); });
+    for(int v = 0; v < 600; ++v) e.erase(v); // erases never compact: every remaining handle stays valid
+    auto st = e.stats();
+    EXPECT_EQ(st.size, 400u);
+    EXPECT_EQ(st.slots, 1000u);
+    EXPECT_EQ(st.free_slots, 600u);
+    EXPECT_EQ(*e.try_get(h999), 999);
+    ASSERT_EQ(e_calls.size(), 1u); // the automatic modes report what they leave to maintain()
+    EXPECT_EQ(e_calls[0], flat::maintenance_reason::fragmented);
+    EXPECT_EQ(e.maintenance_due(), flat::maintenance_reason::fragmented);
+    EXPECT_EQ(e.maintain([&](auto from, auto to){ if(from == h999) h999 = to; }), flat::maintenance_reason::fragmented);
+    EXPECT_EQ(e.stats().slots, 400u);
+    EXPECT_EQ(*e.try_get(h999), 999);
+    EXPECT_EQ(e.maintenance_due(), flat::maintenance_reason::none);
+    EXPECT_TRUE(std::is_sorted(e.begin(), e.end()));
+    EXPECT_EQ(*e.begin(), 600);
+
+    bst<int, std::less<int>, uint32_t, flat::maintenance_policy<NotifyMaintenance>> n;
+    std::vector<flat::maintenance_reason> calls;
+    n.on_maintenance_due([&](flat::maintenance_reason r){ calls.push_back(r); });
+    for(int v = 0; v < 100; ++v) n.insert(v);
+    ASSERT_EQ(calls.size(), 1u); // reported once, not on every deeper insert
+    EXPECT_EQ(calls[0], flat::maintenance_reason::too_deep);
+    EXPECT_EQ(n.stats().height, 100u); // notify never repairs by itself
+    EXPECT_EQ(n.maintain(), flat::maintenance_reason::too_deep);
+    EXPECT_EQ(n.stats().height, 7u);
+    EXPECT_EQ(n.maintenance_due(), flat::maintenance_reason::none);
+    for(int v = 0; v < 60; ++v) n.erase(v);
+    ASSERT_EQ(calls.size(), 2u);
+    EXPECT_EQ(calls[1], flat::maintenance_reason::fragmented);
+    std::size_t moved = 0;
+    EXPECT_EQ(n.maintain([&](auto, auto){ ++moved; }), flat::maintenance_reason::fragmented);
+    EXPECT_EQ(moved, 40u);
+    EXPECT_EQ(n.stats().slots, 40u);
+    calls.clear();
+    for(int v = 1000; v < 1100; ++v) n.insert_sorted(&v, &v + 1); // one-element runs: a chain again
+    ASSERT_EQ(calls.size(), 1u); // sorted inserts trip the depth trigger too
+    EXPECT_EQ(calls[0], flat::maintenance_reason::too_deep);
+    bst<int, std::less<int>, uint32_t, flat::maintenance_policy<EagerMaintenance>> s;
+    for(int v = 0; v < 1000; ++v) s.insert_sorted(&v, &v + 1);
+    EXPECT_LE(s.stats().height, 2u * std::bit_width(1000u));
+
+    bst<int, std::less<int>, uint32_t, flat::maintenance_policy<NotifyMaintenance>> thrower;
+    thrower.on_maintenance_due([](flat::maintenance_reason){ throw std::runtime_error("due"); });
+    int last = 0;
+    for(; last < 100; ++last){
+        try{ thrower.emplace(last); } catch(const std::runtime_error&){ break; }
+    }
+    ASSERT_LT(last, 100);
+    EXPECT_TRUE(thrower.contains(last)); // thrown after linking: the element stays
+    EXPECT_EQ(thrower.size(), static_cast<std::size_t>(last + 1));
+    EXPECT_EQ(static_cast<std::size_t>(std::distance(thrower.begin(), thrower.end())), thrower.size());
+    EXPECT_TRUE(thrower.emplace(1000).second);
+    EXPECT_EQ(thrower.size(), static_cast<std::size_t>(last + 2));
+
+    flat::map<int, int, std::less<int>, uint32_t, flat::maintenance_policy<NotifyMaintenance>> m;
+    for(int k = 0; k < 100; ++k) m[k] = k;
+    EXPECT_EQ(m.maintenance_due(), flat::maintenance_reason::too_deep);
+    m.maintain();
+    EXPECT_EQ(m.maintenance_due(), flat::maintenance_reason::none);
+    EXPECT_EQ(m.at(42), 42);
+}
+
+// Test 53 - set algebra against the std algorithms, merge, and split/join keeping handles
+TEST(FlatBst, SetAlgebraSplitAndJoin){
+    std::set<int> ra, rb;
+    bst<int> a, b;
+    uint32_t seed = 7;
+    auto next = [&]{ seed = seed * 1664525u + 1013904223u; return static_cast<int>(seed >> 22); };
+    for(int i = 0; i < 600; ++i){ int v = next(); ra.insert(v); a.insert(v); }
+    for(int i = 0; i < 400; ++i){ int v = next(); rb.insert(v); b.insert(v); }
+    auto check = [&](const bst<int>& got, auto algo){
+        std::vector<int> want;
+        algo(ra.begin(), ra.end(), rb.begin(), rb.end(), std::back_inserter(want));
+        EXPECT_EQ(inorder_dump(got), want);
+        EXPECT_LE(got.stats().height, static_cast<std::size_t>(std::bit_width(got.size())));
+        EXPECT_EQ(got.stats().free_slots, 0u);
+        };
+    check(a.set_union(b), [](auto... args){ return std::set_union(args...); });
+    check(a.set_intersection(b, flat::layout::eytzinger), [](auto... args){ return std::set_intersection(args...); });
+    check(a.set_difference(b), [](auto... args){ return std::set_difference(args...); });
+    check(a.set_symmetric_difference(b, flat::layout::veb), [](auto... args){ return std::set_symmetric_difference(args...); });
+    EXPECT_TRUE(a.set_intersection(bst<int>{}).empty());
+
+    bst<int> m = a, other = b;
+    m.merge(other); // like std::set::merge: other keeps what m already had
+    std::set<int> rm = ra, rother = rb;
+    rm.merge(rother);
+    EXPECT_EQ(inorder_dump(m), std::vector<int>(rm.begin(), rm.end()));
+    EXPECT_EQ(inorder_dump(other), std::vector<int>(rother.begin(), rother.end()));
+
+    bst<int> t;
+    for(int v = 0; v < 100; ++v) t.insert((v * 37) % 100);
+    const auto h10 = t.find_handle(10);
+    const auto h90 = t.find_handle(90);
+    auto upper = t.split(50);
+    expect_equal_vec(inorder_dump(t), [&]{ std::vector<int> v(50); std::iota(v.begin(), v.end(), 0); return v; }());
+    expect_equal_vec(inorder_dump(upper), [&]{ std::vector<int> v(50); std::iota(v.begin(), v.end(), 50); return v; }());
+    ASSERT_NE(t.try_get(h10), nullptr); // the kept half was only unhooked
+    EXPECT_EQ(*t.try_get(h10), 10);
+    EXPECT_EQ(t.try_get(h90), nullptr);
+    EXPECT_TRUE(t.split(-1).size() == 50 && t.empty()); // everything moves out
+    t.insert(10);
+    const auto again = t.find_handle(10);
+    t.join(upper);
+    EXPECT_TRUE(upper.empty());
+    EXPECT_EQ(t.size(), 51u);
+    EXPECT_EQ(*t.try_get(again), 10); // join keeps this tree's handles
+    EXPECT_EQ(*t.begin(), 10);
+    EXPECT_EQ(*std::prev(t.end()), 99);
+
+    using os_tree = bst<int, std::less<int>, uint32_t, flat::order_statistics_policy<>>;
+    os_tree lo, hi;
+    for(int v = 0; v < 64; ++v) lo.insert(v);
+    for(int v = 100; v < 300; ++v){ hi.insert(v); if(v % 3 == 0) hi.erase(v); } // free slots stay behind
+    const auto h5 = lo.find_handle(5);
+    lo.join(hi);
+    EXPECT_EQ(lo.size(), 64u + 134u);
+    EXPECT_EQ(lo.stats().slots, 64u + 134u);
+    EXPECT_EQ(*lo.nth(64), 100);
+    EXPECT_EQ(lo.rank(299), lo.size() - 1);
+    EXPECT_EQ(*lo.try_get(h5), 5);
+    auto tail = lo.split(150);
+    EXPECT_EQ(lo.rank(149), lo.size() - 1);
+    EXPECT_EQ(*tail.nth(0), 151);
+    EXPECT_EQ(lo.count(0, 1000) + tail.count(0, 1000), 64u + 134u);
+    for(int v = 1000; v < 1200; ++v) lo.insert(v); // reuses the free slots joined and split off
+    EXPECT_EQ(lo.stats().free_slots, 0u);
+    EXPECT_TRUE(std::is_sorted(lo.begin(), lo.end()));
+    const auto before = lo.size();
+    lo.join(lo); // self-join is a no-op
+    EXPECT_EQ(lo.size(), before);
+    const auto slots = lo.stats().slots;
+    for(int i = 0; i < 50; ++i){ auto upper = lo.split(1100); lo.join(upper); } // joins fill the holes splits leave
+    EXPECT_EQ(lo.size(), before);
+    EXPECT_EQ(lo.stats().slots, slots);
+    EXPECT_EQ(lo.rank(1199), lo.size() - 1);
+}
+
+struct CopyCounted final{
+    static inline int copies = 0;
+    int x = 0;
+    explicit CopyCounted(int v = 0) noexcept : x(v){}
+    CopyCounted(const CopyCounted& o) noexcept : x(o.x){ ++copies; }
+    CopyCounted(CopyCounted&&) noexcept = default;
+    CopyCounted& operator=(const CopyCounted& o) noexcept{ x = o.x; ++copies; return *this; }
+    CopyCounted& operator=(CopyCounted&&) noexcept = default;
+    friend bool operator<(const CopyCounted& a, const CopyCounted& b) noexcept{ return a.x < b.x; }
+};
+
+// Test 54 - rebuilds and range builds move values, extract/insert(node) carry them between trees
+TEST(FlatBst, MoveAwareRebuildsAndNodeExtraction){
+    bst<MoveOnly, MoveOnlyComp> mo;
+    for(int v = 0; v < 32; ++v) mo.insert(MoveOnly{v});
+    mo.rebuild_balanced(); // move-only values, which a copying rebuild cannot handle
+    EXPECT_EQ(mo.stats().height, 6u);
+    mo.rebuild_balanced(flat::layout::veb);
+    std::vector<MoveOnly> input;
+    for(int v : {5, 3, 5, 9, 1}) input.emplace_back(v);
+    mo.build_from_range(std::make_move_iterator(input.begin()), std::make_move_iterator(input.end()));
+    std::vector<int> xs;
+    mo.for_each_inorder([&](const MoveOnly& m){ xs.push_back(m.x); });
+    expect_equal_vec(xs, std::vector<int>({1, 3, 5, 9}));
+
+    bst<CopyCounted> cc;
+    for(int v = 0; v < 200; ++v) cc.insert(CopyCounted{(v * 7) % 200});
+    std::vector<CopyCounted> more;
+    for(int v = 200; v > 0; --v) more.emplace_back(v);
+    CopyCounted::copies = 0;
+    cc.rebuild_balanced();
+    cc.rebuild_balanced(std::execution::par);
+    cc.build_from_range(std::make_move_iterator(more.begin()), std::make_move_iterator(more.end()));
+    auto nodes = cc.extract(cc.find_handle(CopyCounted{7}));
+    EXPECT_TRUE(cc.insert(std::move(nodes)).inserted);
+    EXPECT_EQ(CopyCounted::copies, 0);
+    EXPECT_EQ(cc.size(), 200u);
+    EXPECT_EQ(cc.begin()->x, 1);
+
+    using namespace std::literals;
+    bst<std::string> a{"x", "y", "z"}, b{"y"};
+    const auto hy = a.find_handle("y"s);
+    const auto hz = a.find_handle("z"s);
+    auto node = a.extract(hy);
+    ASSERT_FALSE(node.empty());
+    EXPECT_EQ(node.value(), "y");
+    EXPECT_EQ(a.size(), 2u);
+    EXPECT_EQ(a.try_get(hy), nullptr);
+    EXPECT_EQ(*a.try_get(hz), "z"); // other handles survive, as with erase
+    EXPECT_TRUE(a.extract(hy).empty()); // stale
+    auto dup = b.insert(std::move(node));
+    EXPECT_FALSE(dup.inserted); // b had "y": the node comes back
+    EXPECT_EQ(dup.handle, b.find_handle("y"s));
+    ASSERT_TRUE(dup.node);
+    EXPECT_EQ(dup.node.value(), "y");
+    dup.node.value() = "w";
+    auto moved = a.insert(std::move(dup.node));
+    EXPECT_TRUE(moved.inserted);
+    EXPECT_TRUE(moved.node.empty());
+    EXPECT_EQ(*a.try_get(moved.handle), "w");
+    EXPECT_EQ(inorder_dump(a), std::vector<std::string>({"w", "x", "z"}));
+
+    avl_bst from, to;
+    for(int v = 0; v < 100; ++v) from.insert(v);
+    for(int v = 0; v < 100; ++v) to.insert(from.extract(from.find_handle((v * 31) % 100)));
+    EXPECT_TRUE(from.empty());
+    EXPECT_EQ(to.size(), 100u);
+    EXPECT_LE(to.stats().height, 9u);
+    EXPECT_TRUE(std::is_sorted(to.begin(), to.end()));
+}
+
+// Test 55 - make_static_bst builds a lookup table at compile time, laid out in Eytzinger order
+constexpr auto keyword_table = flat::make_static_bst(std::array<std::string_view, 9>{
+    "while", "if", "else", "for", "return", "break", "continue", "do", "if"});
+static_assert(keyword_table.size() == 8); // the duplicate "if" is dropped
+static_assert(keyword_table.contains(std::string_view{"for"}));
+static_assert(!keyword_table.contains(std::string_view{"goto"}));
+static_assert(*keyword_table.try_get(keyword_table.lower_bound_handle(std::string_view{"c"})) == "continue");
+static_assert(keyword_table.upper_bound_handle(std::string_view{"while"}) == keyword_table.npos);
+
+TEST(FlatBst, ConstexprStaticTables){
+    using namespace std::literals;
+    static_assert(std::is_same_v<decltype(keyword_table)::handle_type, uint8_t>);
+    std::vector<std::string_view> words(keyword_table.begin(), keyword_table.end());
+    EXPECT_TRUE(std::is_sorted(words.begin(), words.end()));
+    EXPECT_EQ(words.size(), 8u);
+    for(auto w : words) EXPECT_TRUE(keyword_table.contains(w)); // the same lookups at run time
+    EXPECT_FALSE(keyword_table.contains("whilst"sv));
+
+    // breadth-first slots: the root sits in slot 0, its children in slots 1 and 2
+    std::vector<std::string_view> levels;
+    keyword_table.for_each_slot([&](std::string_view w){ levels.push_back(w); });
+    std::vector<std::string_view> pre;
+    keyword_table.for_each_preorder([&](std::string_view w){ pre.push_back(w); });
+    EXPECT_EQ(levels[0], pre[0]);
+    EXPECT_EQ(levels[0], "for");
+
+    constexpr auto opcodes = flat::make_static_bst(std::array{0x90, 0x0f, 0xc3, 0x0f, 0xe8}, std::greater<int>{}, flat::layout::preorder);
+    static_assert(opcodes.size() == 4 && opcodes.contains(0xc3));
+    EXPECT_EQ(*opcodes.begin(), 0xe8);
+}
+
+// Test 56 - erase_if / erase_range / erase(span) in one pass: survivors keep their handles and come out balanced
+TEST(FlatBst, BulkEraseKeepsSurvivingHandles){
+    bst<int> t;
+    std::set<int> ref;
+    std::vector<bst<int>::handle_type> handles(1000);
+    for(int v = 0; v < 1000; ++v){
+        handles[v] = t.insert(v).first; // sorted: a spine
+        ref.insert(v);
+    }
+    EXPECT_EQ(t.erase_if([](int v){ return v % 5 == 0; }), 200u);
+    std::erase_if(ref, [](int v){ return v % 5 == 0; });
+    for(int v = 0; v < 1000; ++v){
+        if(v % 5 == 0){
+            EXPECT_EQ(t.try_get(handles[v]), nullptr);
+        } else{
+            ASSERT_NE(t.try_get(handles[v]), nullptr);
+            EXPECT_EQ(*t.try_get(handles[v]), v);
+        }
+    }
+    auto st = t.stats();
+    EXPECT_EQ(st.height, static_cast<std::size_t>(std::bit_width(800u)));
+    EXPECT_EQ(st.free_slots, 200u);
+    EXPECT_EQ(t.erase_if([](int){ return false; }), 0u);
+    EXPECT_THROW(t.erase_if([](int v) -> bool{ if(v == 501) throw std::runtime_error("pred"); return true; }), std::runtime_error);
+    EXPECT_EQ(t.size(), 800u); // a throwing predicate erases nothing
+
+    EXPECT_EQ(t.erase_range(100, 200), 80u);
+    ref.erase(ref.lower_bound(100), ref.lower_bound(200));
+    EXPECT_EQ(t.erase_range(300, 300), 0u);
+    EXPECT_EQ(t.erase_range(400, 350), 0u);
+    const std::array<int, 7> keys{999, 7, 3, 3, 5, 2000, 998}; // unsorted, repeated, missing, already erased
+    EXPECT_EQ(t.erase(std::span<const int>(keys)), 4u);
+    for(int k : keys) ref.erase(k);
+    EXPECT_EQ(inorder_dump(t), std::vector<int>(ref.begin(), ref.end()));
+    EXPECT_EQ(*t.try_get(handles[1]), 1);
+    for(int v = 5000; v < 5200; ++v) t.insert(v); // the freed slots are reused
+    st = t.stats();
+    EXPECT_EQ(st.slots, 1000u);
+    EXPECT_EQ(st.free_slots, 284u - 200u);
+
+    using os_tree = bst<int, std::less<int>, uint32_t, flat::order_statistics_policy<>>;
+    os_tree os;
+    for(int v = 0; v < 300; ++v) os.insert((v * 7) % 300);
+    EXPECT_EQ(os.erase_if([](int v){ return v % 3 == 0; }), 100u);
+    EXPECT_EQ(os.erase_range(0, 30), 20u);
+    EXPECT_EQ(os.size(), 180u);
+    EXPECT_EQ(*os.nth(0), 31);
+    EXPECT_EQ(os.rank(299), 179u);
+    EXPECT_EQ(os.count(100, 200), 67u);
+    os.insert(0);
+    EXPECT_EQ(os.rank(31), 1u);
+
+    bst<std::string, std::less<>> words{"apple", "banana", "cherry", "date"};
+    const std::array<std::string_view, 2> gone{"date", "banana"};
+    EXPECT_EQ(words.erase(std::span<const std::string_view>(gone)), 2u);
+    EXPECT_EQ(inorder_dump_any(words), std::vector<std::string>({"apple", "cherry"}));
+
+    bst<int, std::less<int>, uint32_t, flat::maintenance_policy<EagerMaintenance>> m;
+    for(int v = 0; v < 100; ++v) m.insert(v);
+    const auto h70 = m.find_handle(70);
+    EXPECT_EQ(m.erase_if([](int v){ return v < 60; }), 60u); // over max_free_ratio: flagged, not compacted
+    EXPECT_EQ(m.stats().slots, 100u);
+    EXPECT_EQ(*m.try_get(h70), 70);
+    EXPECT_EQ(m.maintenance_due(), flat::maintenance_reason::fragmented);
+    EXPECT_EQ(m.maintain(), flat::maintenance_reason::fragmented);
+    EXPECT_EQ(m.stats().slots, 40u);
+    EXPECT_EQ(*m.begin(), 60);
+}
+
+// Test 57 - a failed allocation in the middle of merge or a rebuild leaves every tree as it was
+struct FailingResource : std::pmr::memory_resource{
+    long countdown = -1; // allocations left before one fails, -1 = never
+    void* do_allocate(size_t bytes, size_t align) override{
+        if(countdown == 0) throw std::bad_alloc();
+        if(countdown > 0) --countdown;
+        return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t align) override{ std::pmr::new_delete_resource()->deallocate(p, bytes, align); }
+    bool do_is_equal(const std::pmr::memory_resource& o) const noexcept override{ return this == &o; }
+};
+
+TEST(FlatBst, FailedAllocationsLeaveTreesIntact){
+    using tree = flat::pmr::bst<std::string>; // nothrow moves: values are moved, not copied
+    FailingResource res;
+    auto fill = [](tree& t, int from, int to){ for(int v = from; v < to; ++v) t.insert(std::to_string(v + 1000)); };
+    for(const auto order : {flat::layout::preorder, flat::layout::eytzinger, flat::layout::veb}){
+        bool merged = false;
+        for(long k = 0; !merged; ++k){
+            tree a(&res), b(&res);
+            fill(a, 0, 300);
+            fill(b, 200, 500);
+            const auto da = inorder_dump_any(a), db = inorder_dump_any(b);
+            res.countdown = k;
+            try{ a.merge(b, order); merged = true; } catch(const std::bad_alloc&){}
+            res.countdown = -1;
+            if(merged){
+                EXPECT_EQ(a.size(), 500u);
+                EXPECT_EQ(b.size(), 100u);
+            } else{
+                ASSERT_EQ(inorder_dump_any(a), da);
+                ASSERT_EQ(inorder_dump_any(b), db);
+            }
+        }
+        bool rebuilt = false;
+        for(long k = 0; !rebuilt; ++k){
+            tree t(&res);
+            fill(t, 0, 300);
+            const auto before = inorder_dump_any(t);
+            res.countdown = k;
+            try{ t.rebuild_balanced(order); rebuilt = true; } catch(const std::bad_alloc&){}
+            res.countdown = -1;
+            ASSERT_EQ(inorder_dump_any(t), before);
+        }
+    }
+}